@@ -0,0 +1,29 @@
+# Input Variables
+#    BENCHMARK_ROOT
+# Produces:
+#    BENCHMARK_LIBRARY
+#    BENCHMARK_INCLUDE_DIR
+
+
+FIND_PATH(BENCHMARK_INCLUDE_DIR benchmark/benchmark.h
+	HINTS ${BENCHMARK_ROOT}/include)
+
+FIND_LIBRARY(BENCHMARK_LIBRARY_MAIN NAMES benchmark
+	HINTS ${BENCHMARK_ROOT}/lib)
+
+list(APPEND BENCHMARK_LIBRARY ${BENCHMARK_LIBRARY_MAIN} -lpthread)
+
+IF (BENCHMARK_INCLUDE_DIR AND BENCHMARK_LIBRARY_MAIN)
+   SET(BENCHMARK_FOUND TRUE)
+ENDIF (BENCHMARK_INCLUDE_DIR AND BENCHMARK_LIBRARY_MAIN)
+
+IF (BENCHMARK_FOUND)
+   IF (NOT BENCHMARK_FIND_QUIETLY)
+      MESSAGE(STATUS "Found BENCHMARK_LIBRARY: ${BENCHMARK_LIBRARY}")
+      MESSAGE(STATUS "Found BENCHMARK_INCLUDE_DIR: ${BENCHMARK_INCLUDE_DIR}")
+   ENDIF (NOT BENCHMARK_FIND_QUIETLY)
+ELSE (BENCHMARK_FOUND)
+   IF (BENCHMARK_FIND_REQUIRED)
+      MESSAGE(FATAL_ERROR "Could not find BENCHMARK")
+   ENDIF (BENCHMARK_FIND_REQUIRED)
+ENDIF (BENCHMARK_FOUND)
@@ -46,12 +46,12 @@ namespace ibmisc {
 
 
 /** Converts a const std::vector to a const Blitz++ 1-D array that shares the same memory. */
-template<class T>
-blitz::Array<T,1> const to_blitz(std::vector<T> const &vec)
+template<class T, class AllocT>
+blitz::Array<T,1> const to_blitz(std::vector<T, AllocT> const &vec)
     { VECTOR_TO_BLITZ_BODY; }
 
-template<class T>
-blitz::Array<T,1> to_blitz(std::vector<T> &vec)
+template<class T, class AllocT>
+blitz::Array<T,1> to_blitz(std::vector<T, AllocT> &vec)
     { VECTOR_TO_BLITZ_BODY; }
 
 #undef VECTOR_TO_BLITZ_BODY
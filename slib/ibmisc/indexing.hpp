@@ -170,6 +170,75 @@ bool in_domain(
 }
 
 // ============================================
+// Domain-driven (hyperslab) I/O
+
+/** Converts a Domain to the start/count of a NetCDF hyperslab. */
+template<class TupleT>
+void domain_to_slab(
+    Domain<TupleT> const &domain,
+    int rank,
+    std::vector<size_t> &startp,
+    std::vector<size_t> &countp)
+{
+    if (domain.rank() != rank) {
+        (*ibmisc_error)(-1,
+            "Domain of rank %d used for array of rank %d", domain.rank(), rank);
+    }
+    startp.resize(rank);
+    countp.resize(rank);
+    for (int k=0; k<rank; ++k) {
+        if (domain.low[k] < 0 || domain.high[k] < domain.low[k]) {
+            (*ibmisc_error)(-1,
+                "Invalid Domain [%ld, %ld) in dimension #%d",
+                (long)domain.low[k], (long)domain.high[k], k);
+        }
+        startp[k] = domain.low[k];
+        countp[k] = domain.high[k] - domain.low[k];
+    }
+}
+
+/** Defines a variable over the whole (global) dims, and reads or
+writes just the part of it in domain.  val holds that part (for
+example, this MPI rank's share of the grid).  If alloc and reading,
+val is allocated with base domain.low, so it can be indexed with
+global indices; otherwise it must already have extent
+domain.high-domain.low.  With a parallel NcIO, all ranks write
+collectively.  See the start/count version of ncio_blitz(). */
+template<class TypeT, int RANK, class TupleT>
+void ncio_blitz(
+    NcIO &ncio,
+    blitz::Array<TypeT, RANK> &val,
+    bool alloc,
+    std::string const &vname,
+    netCDF::NcType const &nc_type,
+    std::vector<netCDF::NcDim> const &dims,
+    Domain<TupleT> const &domain)
+{
+    std::vector<size_t> startp, countp;
+    domain_to_slab(domain, RANK, startp, countp);
+    ncio_blitz(ncio, val, alloc, vname, nc_type, dims, startp, countp);
+}
+
+/** Like the Domain version of ncio_blitz(), for a 1-D std::vector. */
+template<class TypeT, class TupleT>
+void ncio_vector(
+    NcIO &ncio,
+    std::vector<TypeT> &val,
+    bool alloc,
+    std::string const &vname,
+    netCDF::NcType const &nc_type,
+    std::vector<netCDF::NcDim> const &dims,
+    Domain<TupleT> const &domain)
+{
+    std::vector<size_t> startp, countp;
+    domain_to_slab(domain, 1, startp, countp);
+
+    get_or_add_var(ncio, vname, nc_type, dims);
+
+    ncio += std::bind(&nc_rw_vector_slab<TypeT>,
+        ncio.nc, ncio.rw, &val, alloc, startp[0], countp[0], vname);
+}
+// ============================================
 
 
 
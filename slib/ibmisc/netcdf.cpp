@@ -20,6 +20,10 @@
 #include <netcdf>
 #include <sstream>
 #include <ibmisc/netcdf.hpp>
+#include <netcdf.h>
+#ifdef USE_MPI
+#include <netcdf_par.h>
+#endif
 
 
 using namespace netCDF;
@@ -28,6 +32,63 @@ namespace ibmisc {
 
 bool netcdf_debug = false;
 
+#ifdef USE_MPI
+// ===============================================
+static int open_par(
+    std::string const &filePath,
+    netCDF::NcFile::FileMode fMode,
+    MPI_Comm comm, MPI_Info info)
+{
+    int ncid;
+    int err;
+    switch(fMode) {
+        case NcFile::FileMode::read :
+            err = nc_open_par(filePath.c_str(), NC_NOWRITE | NC_MPIIO, comm, info, &ncid);
+        break;
+        case NcFile::FileMode::write :
+            err = nc_open_par(filePath.c_str(), NC_WRITE | NC_MPIIO, comm, info, &ncid);
+        break;
+        case NcFile::FileMode::replace :
+            err = nc_create_par(filePath.c_str(), NC_NETCDF4 | NC_MPIIO | NC_CLOBBER, comm, info, &ncid);
+        break;
+        case NcFile::FileMode::newFile :
+            err = nc_create_par(filePath.c_str(), NC_NETCDF4 | NC_MPIIO | NC_NOCLOBBER, comm, info, &ncid);
+        break;
+    }
+    if (err != NC_NOERR) {
+        (*ibmisc_error)(-1,
+            "Cannot open %s for parallel I/O: %s", filePath.c_str(), nc_strerror(err));
+    }
+    return ncid;
+}
+
+NcIO::NcIO(std::string const &filePath, netCDF::NcFile::FileMode fMode,
+    MPI_Comm comm, MPI_Info info) :
+    own_nc(true),
+    _par_ncid(open_par(filePath, fMode, comm, info)),
+    _par_nc(_par_ncid),
+    nc(&_par_nc),
+    rw(fMode == netCDF::NcFile::FileMode::read ? 'r' : 'w'),
+    define(rw == 'w'),
+    parallel(true) {}
+#endif
+
+void NcIO::_par_close()
+{
+    if (_par_ncid < 0) return;
+    int err = nc_close(_par_ncid);
+    _par_ncid = -1;
+    if (err != NC_NOERR) {
+        (*ibmisc_error)(-1, "nc_close(): %s", nc_strerror(err));
+    }
+}
+
+NcIO::~NcIO()
+{
+    // Parallel files have no NcFile to close them; don't throw here
+    if (parallel && _par_ncid >= 0) nc_close(_par_ncid);
+}
+
 
 void _check_nc_rank(
     netCDF::NcVar const &ncvar,
@@ -185,6 +246,16 @@ netCDF::NcVar get_or_add_var(
                 "Variable %s required but not found", vname.c_str());
         }
     }
+#ifdef USE_MPI
+    // Let all ranks read/write their hyperslabs in one call
+    if (ncio.parallel) {
+        int err = nc_var_par_access(ncio.nc->getId(), ncvar.getId(), NC_COLLECTIVE);
+        if (err != NC_NOERR) {
+            (*ibmisc_error)(-1,
+                "Cannot set collective access on %s: %s", vname.c_str(), nc_strerror(err));
+        }
+    }
+#endif
     return ncvar;
 }
 
@@ -27,6 +27,9 @@
 #include <ibmisc/blitz.hpp>
 #include <ibmisc/enum.hpp>
 #include <type_traits>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
 
 namespace ibmisc {
 
@@ -54,10 +57,18 @@ class NcIO {
     std::vector<std::function<void ()>> _io;
     netCDF::NcFile _mync;  // NcFile lacks proper move constructor
     bool own_nc;
+    // Parallel mode: the file is opened through the NetCDF-C API,
+    // since NcFile cannot open files for MPI-IO.  Present (and unused,
+    // _par_ncid=-1) in serial builds too, so NcIO has the same layout
+    // whether or not USE_MPI is defined.
+    int _par_ncid;
+    netCDF::NcGroup _par_nc;
 public:
     netCDF::NcGroup * const nc;
     char const rw;
     const bool define;
+    /** True if the file was opened for parallel (MPI-IO) access. */
+    const bool parallel;
 
     /** @param _mode:
         'd' : Define and write (if user calls operator() later)
@@ -66,15 +77,34 @@ public:
     NcIO(netCDF::NcGroup *_nc, char _mode) :
         nc(_nc),
         own_nc(false),
+        _par_ncid(-1),
         rw(_mode == 'd' ? 'w' : 'r'),
-        define(_mode == 'd') {}
+        define(_mode == 'd'),
+        parallel(false) {}
 
     NcIO(std::string const &filePath, netCDF::NcFile::FileMode fMode = netCDF::NcFile::FileMode::read) :
         _mync(filePath, fMode, netCDF::NcFile::FileFormat::nc4),
         own_nc(true),
+        _par_ncid(-1),
         nc(&_mync),
         rw(fMode == netCDF::NcFile::FileMode::read ? 'r' : 'w'),
-        define(rw == 'w') {}
+        define(rw == 'w'),
+        parallel(false) {}
+
+#ifdef USE_MPI
+    /** Opens a NetCDF-4 file for parallel I/O through MPI-IO
+    (requires NetCDF-C built with parallel HDF5).
+
+    Every rank of comm must construct the NcIO, define the same
+    dimensions and variables, and call operator() / close().  Variables
+    obtained through get_or_add_var() use collective access, so each
+    rank can write (or read) its own hyperslab in one collective call;
+    see the Domain overloads of ncio_blitz() and ncio_vector(). */
+    NcIO(std::string const &filePath, netCDF::NcFile::FileMode fMode,
+        MPI_Comm comm, MPI_Info info = MPI_INFO_NULL);
+#endif
+
+    ~NcIO();
 
     void operator+=(std::function<void ()> const &fn)
     {
@@ -88,6 +118,11 @@ public:
     }
 
     void close() {
+        if (parallel) {
+            (*this)();
+            _par_close();
+            return;
+        }
         if (own_nc) {
             (*this)();
             _mync.close();
@@ -95,6 +130,9 @@ public:
             (*ibmisc_error)(-1, "NcIO::close() only valid on NcGroups it owns.");
         }
     }
+
+private:
+    void _par_close();
 };
 // ===========================================================
 // Dimension Wrangling
@@ -493,6 +531,89 @@ void nc_rw_blitz(
     }
 }
 // ---------------------------------------------------
+/** Reads or writes the hyperslab of a NetCDF variable that starts at
+startp and has the extent of val.  val must be unit strides, row
+major; its base does not matter.  In parallel mode (see NcIO), each
+rank passes its own hyperslab. */
+template<class TypeT, int RANK>
+void nc_rw_blitz_slab(
+    netCDF::NcGroup *nc,
+    char rw,
+    blitz::Array<TypeT, RANK> *val,
+    std::vector<size_t> const &startp,
+    std::string const &vname);
+
+template<class TypeT, int RANK>
+void nc_rw_blitz_slab(
+    netCDF::NcGroup *nc,
+    char rw,
+    blitz::Array<TypeT, RANK> *val,
+    std::vector<size_t> const &startp,
+    std::string const &vname)
+{
+    netCDF::NcVar ncvar = nc->getVar(vname);
+
+    _check_nc_rank(ncvar, RANK);
+    _check_blitz_strides(*val);
+
+    std::vector<size_t> countp(RANK);
+    for (int k=0; k<RANK; ++k) {
+        countp[k] = val->extent(k);
+
+        netCDF::NcDim ncdim(ncvar.getDim(k));
+        if ((rw == 'r' || !ncdim.isUnlimited()) &&
+            (startp[k] + countp[k] > ncdim.getSize()))
+        {
+            (*ibmisc_error)(-1,
+                "Hyperslab [%ld, %ld) of dimension #%d is outside %s:%s (%ld) in NetCDF",
+                startp[k], startp[k] + countp[k], k, ncvar.getName().c_str(),
+                ncdim.getName().c_str(), ncdim.getSize());
+        }
+    }
+
+    switch(rw) {
+        case 'r' :
+            ncvar.getVar(startp, countp, val->data());
+        break;
+        case 'w' :
+            ncvar.putVar(startp, countp, val->data());
+        break;
+    }
+}
+// ---------------------------------------------------
+/** Checks that startp and countp of a hyperslab match the rank of
+the blitz::Array. */
+inline void _check_slab_rank(
+    char const *fname,
+    std::string const &vname,
+    std::vector<size_t> const &startp,
+    std::vector<size_t> const &countp,
+    int rank)
+{
+    if (startp.size() != (size_t)rank || countp.size() != (size_t)rank) {
+        (*ibmisc_error)(-1,
+            "%s(%s): startp[%ld] and countp[%ld] must have rank %d",
+            fname, vname.c_str(), startp.size(), countp.size(), rank);
+    }
+}
+
+/** Allocates val to hold the hyperslab [startp, startp+countp),
+based at startp, so it is indexed the same as the full NetCDF
+variable. */
+template<class TypeT, int RANK>
+void _alloc_blitz_slab(
+    blitz::Array<TypeT, RANK> &val,
+    std::vector<size_t> const &startp,
+    std::vector<size_t> const &countp)
+{
+    blitz::TinyVector<int,RANK> lbound, extent;
+    for (int k=0; k<RANK; ++k) {
+        lbound[k] = startp[k];
+        extent[k] = countp[k];
+    }
+    val.reference(blitz::Array<TypeT,RANK>(lbound, extent));
+}
+// ---------------------------------------------------
 
 template<class TypeT, int RANK>
 blitz::Array<TypeT, RANK> nc_read_blitz(
@@ -504,6 +625,23 @@ blitz::Array<TypeT, RANK> nc_read_blitz(
     return val;
 }
 
+/** Reads just the hyperslab [startp, startp+countp) of a variable.
+The result is based at startp. */
+template<class TypeT, int RANK>
+blitz::Array<TypeT, RANK> nc_read_blitz(
+    netCDF::NcGroup *nc,
+    std::string const &vname,
+    std::vector<size_t> const &startp,
+    std::vector<size_t> const &countp)
+{
+    _check_slab_rank("nc_read_blitz", vname, startp, countp, RANK);
+
+    blitz::Array<TypeT, RANK> val;
+    _alloc_blitz_slab(val, startp, countp);
+    nc_rw_blitz_slab(nc, 'r', &val, startp, vname);
+    return val;
+}
+
 
 
 /** Define and write a blitz::Array. */
@@ -523,6 +661,40 @@ void ncio_blitz(
         ncio.nc, ncio.rw, &val, alloc, vname);
 
 }
+
+/** Define a variable over the full dims, and read/write just the
+hyperslab [startp, startp+countp) of it.
+
+@param alloc If reading, allocate val based at startp, so it is
+    indexed the same as the full variable.  Otherwise, val must
+    already have extent countp (its base does not matter). */
+template<class TypeT, int RANK>
+void ncio_blitz(
+    NcIO &ncio,
+    blitz::Array<TypeT, RANK> &val,
+    bool alloc,
+    std::string const &vname,
+    netCDF::NcType const &nc_type,
+    std::vector<netCDF::NcDim> const &dims,
+    std::vector<size_t> const &startp,
+    std::vector<size_t> const &countp)
+{
+    _check_slab_rank("ncio_blitz", vname, startp, countp, RANK);
+
+    get_or_add_var(ncio, vname, nc_type, dims);
+
+    if (alloc && ncio.rw == 'r') _alloc_blitz_slab(val, startp, countp);
+    for (int k=0; k<RANK; ++k) {
+        if ((size_t)val.extent(k) != countp[k]) {
+            (*ibmisc_error)(-1,
+                "Dimension #%d (%d) of blitz::Array must match hyperslab [%ld, %ld) of %s",
+                k, val.extent(k), startp[k], startp[k] + countp[k], vname.c_str());
+        }
+    }
+
+    ncio += std::bind(&nc_rw_blitz_slab<TypeT, RANK>,
+        ncio.nc, ncio.rw, &val, startp, vname);
+}
 // ----------------------------------------------------
 // =================================================
 // Specializations for std::vector instead of blitz::Array
@@ -577,6 +749,39 @@ void nc_rw_vector(
     if (netcdf_debug) fprintf(stderr, "END nc_rw_vector(%s)\n", vname.c_str());
 }
 
+/** Like nc_rw_blitz_slab(), for the 1-D hyperslab [start, start+count).
+If alloc and reading, val is resized to count. */
+template<class TypeT>
+void nc_rw_vector_slab(
+    netCDF::NcGroup *nc,
+    char rw,
+    std::vector<TypeT> *val,
+    bool alloc,
+    size_t start,
+    size_t count,
+    std::string const &vname);
+
+template<class TypeT>
+void nc_rw_vector_slab(
+    netCDF::NcGroup *nc,
+    char rw,
+    std::vector<TypeT> *val,
+    bool alloc,
+    size_t start,
+    size_t count,
+    std::string const &vname)
+{
+    if (alloc && rw == 'r') val->resize(count);
+    if (val->size() != count) {
+        (*ibmisc_error)(-1,
+            "Size (%ld) of std::vector must match the hyperslab of %s (%ld)",
+            val->size(), vname.c_str(), count);
+    }
+
+    blitz::Array<TypeT,1> bval(val->data(), blitz::shape(count), blitz::neverDeleteData);
+    nc_rw_blitz_slab(nc, rw, &bval, {start}, vname);
+}
+
 template<class TypeT>
 std::vector<TypeT> nc_read_vector(
     netCDF::NcGroup *nc,
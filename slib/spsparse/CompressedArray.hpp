@@ -0,0 +1,367 @@
+/*
+ * IBMisc: Misc. Routines for IceBin (and other code)
+ * Copyright (c) 2013-2016 by Elizabeth Fischer
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPSPARSE_COMPRESSED_ARRAY_HPP
+#define SPSPARSE_COMPRESSED_ARRAY_HPP
+
+#include <spsparse/VectorCooArray.hpp>
+
+namespace spsparse {
+
+/** @defgroup compressed_array CompressedArray.hpp
+@brief Compressed sparse row (CSR) and column (CSC) matrices.
+
+A CompressedArray is always consolidated: it keeps the beginning of
+each row (or column) persistently, instead of recomputing
+dim_beginnings() whenever it is used.  It has the same accumulator
+interface as VectorCooArray (set_shape(), add()), but elements must be
+added in sorted order, without duplicates.  This is exactly what
+spsparse::consolidate() and spsparse::multiply() produce.
+
+Code Example
+@code
+VectorCooMatrix<int, double> A;
+...
+A.consolidate({0,1});
+CsrArray<int, double> Acsr(std::move(A));     // Zero-copy
+
+// Or build it directly
+CsrArray<int, double> Bcsr;
+consolidate(Bcsr, A, {0,1});
+@endcode
+
+@{
+*/
+
+/** @brief Xiter through the non-empty rows (or columns) of a CompressedArray.
+
+Same interface as spsparse::DimBeginningsXiter, but the row numbers are
+stored, not looked up.
+
+@see spsparse::CompressedArray::dim_beginnings_xiter() */
+template<class CompressedArrayT>
+class CompressedRowXiter : public STLXiter<typename std::vector<typename CompressedArrayT::index_type>::const_iterator>
+{
+public:
+    SPSPARSE_LOCAL_TYPES(CompressedArrayT);
+    typedef STLXiter<typename std::vector<index_type>::const_iterator> super;
+
+protected:
+    CompressedArrayT const *arr;
+
+public:
+    CompressedRowXiter(CompressedArrayT const *_arr) :
+        super(_arr->major_indices().begin(), _arr->major_indices().end()),
+        arr(_arr) {}
+
+    /** @brief Iterate along the current row (or column).
+    @param _val_dim Dimension to report via operator*() (ignored; always the minor dimension). */
+    typedef ValSTLXiter<typename CompressedArrayT::const_dim_iterator> sub_xiter_type;
+    sub_xiter_type sub_xiter(int /*_val_dim*/ = -1)
+    {
+        size_t const r = this->ii - this->begin;
+        auto const &db(arr->dim_beginnings());
+        return sub_xiter_type(
+            arr->dim_iter(CompressedArrayT::minor_dim, db[r]),
+            arr->dim_iter(CompressedArrayT::minor_dim, db[r+1]));
+    }
+
+    // No val()
+};
+// -----------------------------------------------------
+/** @brief Rank-2 sparse array stored in compressed row (MAJOR_DIM=0) or
+compressed column (MAJOR_DIM=1) form.
+
+Only non-empty rows are stored.  For row r (0 <= r < nmajor()),
+major_indices()[r] is its row number, and its elements are at offsets
+[dim_beginnings()[r], dim_beginnings()[r+1]).
+
+@see spsparse::CsrArray, spsparse::CscArray */
+template<class IndexT, class ValT, int MAJOR_DIM>
+class CompressedArray
+{
+public:
+    static const int rank = 2;
+    static const int major_dim = MAJOR_DIM;
+    static const int minor_dim = 1 - MAJOR_DIM;
+    typedef IndexT index_type;
+    typedef ValT val_type;
+    typedef std::array<index_type, rank> indices_type;
+
+    std::array<size_t, rank> shape;     // Extent of each dimension
+    void set_shape(std::array<size_t, rank> const &_shape) { shape = _shape; }
+
+protected:
+    typedef CompressedArray<IndexT, ValT, MAJOR_DIM> ThisCompressedArrayT;
+
+    std::vector<IndexT> major_vec;          // Row number of each non-empty row
+    std::vector<size_t> _dim_beginnings;    // Start of each row, plus sentinel
+    std::vector<IndexT> minor_vec;          // Column of each element
+    std::vector<ValT> val_vec;
+
+public:
+    /** Always {major_dim, minor_dim}: a CompressedArray is always consolidated. */
+    std::array<int, rank> const sort_order;
+
+    CompressedArray();
+
+    CompressedArray(std::array<size_t, rank> const &_shape);
+
+    /** @brief Zero-copy conversion from a consolidated VectorCooArray.
+
+    The column and value vectors (and the VectorCooArray's cached
+    dim_beginnings) are moved, not copied.  coo is left empty.
+    @param coo Must be consolidated with sort_order {MAJOR_DIM, 1-MAJOR_DIM}. */
+    explicit CompressedArray(VectorCooArray<IndexT, ValT, rank> &&coo);
+
+    std::unique_ptr<ThisCompressedArrayT> new_blank() const
+        { return std::unique_ptr<ThisCompressedArrayT>(new ThisCompressedArrayT(shape)); }
+    ThisCompressedArrayT make_blank() const
+        { return ThisCompressedArrayT(shape); }
+
+    // Move semantics
+    CompressedArray(CompressedArray &&other);
+    void operator=(ThisCompressedArrayT &&other);
+
+    // -------------------------------------------------
+    size_t size() const
+        { return val_vec.size(); }
+    /** Number of non-empty rows (or columns). */
+    size_t nmajor() const
+        { return major_vec.size(); }
+    void clear();
+    void reserve(size_t size);
+
+    /** @note index(major_dim, ix) requires a binary search; prefer
+    iterating with dim_beginnings_xiter(). */
+    IndexT const &index(int dim, size_t ix) const;
+
+    ValT &val(size_t ix)
+        { return val_vec[ix]; }
+    ValT const &val(size_t ix) const
+        { return val_vec[ix]; }
+
+    std::array<IndexT, rank> index(int ix) const {
+        std::array<IndexT, rank> index_ret;
+        for (int k=0; k<rank; ++k) index_ret[k] = index(k, ix);
+        return index_ret;
+    }
+
+    std::vector<IndexT> const &major_indices() const
+        { return major_vec; }
+    blitz::Array<IndexT, 1> minor_indices() const
+        { return ibmisc::to_blitz(minor_vec); }
+    blitz::Array<ValT, 1> vals() const
+        { return ibmisc::to_blitz(val_vec); }
+
+    // -------------------------------------------------
+    typedef CooIterator<const std::array<IndexT, rank>, const IndexT, rank, const ValT, const ThisCompressedArrayT> const_iterator;
+
+    const_iterator cbegin(int ix = 0) const
+        { return const_iterator(this, ix); }
+    const_iterator cend(int ix = 0) const
+        { return const_iterator(this, size() + ix); }
+    const_iterator begin(int ix = 0) const
+        { return const_iterator(this, ix); }
+    const_iterator end(int ix = 0) const
+        { return const_iterator(this, size() + ix); }
+
+    typedef DimIndexIter<const IndexT, const ValT, const_iterator> const_dim_iterator;
+
+    const_dim_iterator dim_iter(int dim, int ix) const
+        { return const_dim_iterator(dim, const_iterator(this, ix)); }
+    const_dim_iterator dim_begin(int dim) const
+        { return dim_iter(dim, 0); }
+    const_dim_iterator dim_end(int dim) const
+        { return dim_iter(dim, size()); }
+
+    // -------------------------------------------------
+    /** Appends an element.  Elements must be added in sorted order
+    (row major for CSR, column major for CSC), with no duplicates. */
+    void add(std::array<IndexT, rank> const index, ValT const val);
+
+    /** Checks that we are being told we're sorted the way we are. */
+    void set_sorted(std::array<int, rank> const &_sort_order);
+
+    blitz::Array<ValT, rank> to_dense(double fill_value = 0);
+
+    /** Offset of the beginning of each non-empty row (or column), plus a sentinel. */
+    std::vector<size_t> const &dim_beginnings() const
+        { return _dim_beginnings; }
+
+    typedef CompressedRowXiter<ThisCompressedArrayT> dim_beginnings_xiter_type;
+    dim_beginnings_xiter_type dim_beginnings_xiter() const
+        { return dim_beginnings_xiter_type(this); }
+};
+
+template<class IndexT, class ValT>
+using CsrArray = CompressedArray<IndexT, ValT, 0>;
+
+template<class IndexT, class ValT>
+using CscArray = CompressedArray<IndexT, ValT, 1>;
+
+/** Re-sorted (eg: for a transposed multiply) via a VectorCooArray */
+template<class IndexT, class ValT, int MAJOR_DIM>
+struct resorted_type<CompressedArray<IndexT, ValT, MAJOR_DIM>> {
+    typedef VectorCooArray<IndexT, ValT, 2> type;
+};
+
+// --------------------------- Method Definitions
+template<class IndexT, class ValT, int MAJOR_DIM>
+CompressedArray<IndexT, ValT, MAJOR_DIM>::
+    CompressedArray() : _dim_beginnings(1, 0), sort_order({MAJOR_DIM, 1-MAJOR_DIM})
+    {
+        for (int k=0; k<rank; ++k) shape[k] = -1;   // User must set this later
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+CompressedArray<IndexT, ValT, MAJOR_DIM>::
+    CompressedArray(std::array<size_t, rank> const &_shape)
+    : shape(_shape), _dim_beginnings(1, 0), sort_order({MAJOR_DIM, 1-MAJOR_DIM})
+    {}
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+CompressedArray<IndexT, ValT, MAJOR_DIM>::
+    CompressedArray(VectorCooArray<IndexT, ValT, rank> &&coo)
+    : shape(coo.shape), sort_order({MAJOR_DIM, 1-MAJOR_DIM})
+    {
+        if (coo.edit_mode || coo.sort_order != sort_order) {
+            (*spsparse_error)(-1,
+                "CompressedArray(VectorCooArray &&) requires the VectorCooArray be consolidated with sort_order {%d,%d}",
+                MAJOR_DIM, 1-MAJOR_DIM);
+        }
+
+        coo.dim_beginnings();       // Make sure it's computed
+        _dim_beginnings = std::move(coo._dim_beginnings);
+        if (_dim_beginnings.size() == 0) _dim_beginnings.push_back(0);
+
+        major_vec.reserve(_dim_beginnings.size() - 1);
+        for (size_t r=0; r+1 < _dim_beginnings.size(); ++r)
+            major_vec.push_back(coo.index(MAJOR_DIM, _dim_beginnings[r]));
+
+        minor_vec = std::move(coo.index_vecs[minor_dim]);
+        val_vec = std::move(coo.val_vec);
+        coo.clear();
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+CompressedArray<IndexT, ValT, MAJOR_DIM>::
+    CompressedArray(CompressedArray &&other) :
+        shape(other.shape),
+        major_vec(std::move(other.major_vec)),
+        _dim_beginnings(std::move(other._dim_beginnings)),
+        minor_vec(std::move(other.minor_vec)),
+        val_vec(std::move(other.val_vec)),
+        sort_order(other.sort_order) {}
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+    void CompressedArray<IndexT, ValT, MAJOR_DIM>::operator=(ThisCompressedArrayT &&other) {
+        shape = other.shape;
+        major_vec = std::move(other.major_vec);
+        _dim_beginnings = std::move(other._dim_beginnings);
+        minor_vec = std::move(other.minor_vec);
+        val_vec = std::move(other.val_vec);
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+void CompressedArray<IndexT, ValT, MAJOR_DIM>::clear() {
+        major_vec.clear();
+        _dim_beginnings.clear();
+        _dim_beginnings.push_back(0);
+        minor_vec.clear();
+        val_vec.clear();
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+void CompressedArray<IndexT, ValT, MAJOR_DIM>::reserve(size_t size) {
+        minor_vec.reserve(size);
+        val_vec.reserve(size);
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+IndexT const &CompressedArray<IndexT, ValT, MAJOR_DIM>::index(int dim, size_t ix) const
+    {
+        if (dim == minor_dim) return minor_vec[ix];
+
+        // Find the row containing ix
+        auto ii(std::upper_bound(_dim_beginnings.begin(), _dim_beginnings.end(), ix));
+        return major_vec[(ii - _dim_beginnings.begin()) - 1];
+    }
+
+// ------------------------------------------------------------------------
+template<class IndexT, class ValT, int MAJOR_DIM>
+    void CompressedArray<IndexT, ValT, MAJOR_DIM>::add(std::array<IndexT, rank> const index, ValT const val)
+    {
+        // Check bounds
+        for (int i=0; i<rank; ++i) {
+            if (index[i] < 0 || index[i] >= shape[i]) {
+                (*spsparse_error)(-1,
+                    "Sparse index out of bounds: index=(%ld %ld) vs. shape=(%ld %ld)",
+                    (long)index[0], (long)index[1], shape[0], shape[1]);
+            }
+        }
+
+        IndexT const major = index[MAJOR_DIM];
+        IndexT const minor = index[minor_dim];
+        if (major_vec.size() == 0 || major > major_vec.back()) {
+            // Start a new row
+            major_vec.push_back(major);
+            _dim_beginnings.push_back(size() + 1);
+        } else if (major == major_vec.back() && minor > minor_vec.back()) {
+            // Continue the current row
+            ++_dim_beginnings.back();
+        } else {
+            (*spsparse_error)(-1,
+                "CompressedArray::add(): (%ld %ld) added out of order; "
+                "elements must be added sorted by dimension %d, then %d, without duplicates",
+                (long)index[0], (long)index[1], MAJOR_DIM, minor_dim);
+        }
+
+        minor_vec.push_back(minor);
+        val_vec.push_back(val);
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+    void CompressedArray<IndexT, ValT, MAJOR_DIM>::set_sorted(std::array<int, rank> const &_sort_order)
+    {
+        if (_sort_order != sort_order) {
+            (*spsparse_error)(-1,
+                "CompressedArray is always sorted {%d,%d}; cannot be sorted {%d,%d}",
+                sort_order[0], sort_order[1], _sort_order[0], _sort_order[1]);
+        }
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+    blitz::Array<ValT, 2> CompressedArray<IndexT, ValT, MAJOR_DIM>::to_dense(double fill_value)
+    {
+        blitz::Array<ValT, rank> ret(ibmisc::to_tiny<int,size_t,rank>(shape));
+        ret = fill_value;
+        DenseAccum<ThisCompressedArrayT> accum(ret);
+        copy(accum, *this);
+        return ret;
+    }
+
+// ---------------------------------------------------------------------------
+template<class IndexT, class ValT, int MAJOR_DIM>
+std::ostream &operator<<(std::ostream &os, spsparse::CompressedArray<IndexT, ValT, MAJOR_DIM> const &A)
+    { return spsparse::_ostream_out_array(os, A); }
+
+/** @} */
+
+}   // Namespace
+#endif  // Guard
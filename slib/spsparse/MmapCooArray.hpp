@@ -0,0 +1,632 @@
+/*
+ * IBMisc: Misc. Routines for IceBin (and other code)
+ * Copyright (c) 2013-2016 by Elizabeth Fischer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPSPARSE_MMAP_COOARRAY_HPP
+#define SPSPARSE_MMAP_COOARRAY_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <type_traits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spsparse/array.hpp>
+
+namespace spsparse {
+
+/** @defgroup mmap_coo_array MmapCooArray.hpp
+@brief Read-only COO arrays mapped straight from a binary file.
+
+Loading a big regrid matrix through NetCDF copies every element onto
+the heap, once per process.  MmapCooArray instead maps a file written
+by MmapCooArray::write() (read-only, MAP_SHARED), so every process on
+a node shares one page-cache copy and opening is near-instant.
+
+File layout (native byte order; every section starts on a 64-byte
+boundary):
+    MmapCooHeader
+    int32_t sort_order[rank]
+    uint64_t shape[rank]
+    IndexT index[rank][nnz]       (one column per dimension)
+    ValT val[nnz]
+    uint64_t dim_beginnings[ndim_beginnings]    (if sorted)
+
+Code Example
+@code
+VectorCooMatrix<int, double> A;
+...
+A.consolidate({0,1});
+MmapCooMatrix<int, double>::write("A.spsparse", A);
+
+MmapCooMatrix<int, double> Am("A.spsparse");
+multiply(yaccum, Am, x);
+@endcode
+
+@{
+*/
+
+/** @brief Fixed part of the header of an MmapCooArray file. */
+struct MmapCooHeader {
+    char magic[8];          // "SPSPCOO1"
+    uint32_t rank;
+    uint32_t index_bytes;   // sizeof(IndexT)
+    uint32_t val_bytes;     // sizeof(ValT)
+    uint32_t val_is_float;  // std::is_floating_point<ValT>
+    uint64_t nnz;
+    uint64_t ndim_beginnings;   // 0 if not sorted
+};
+
+/** @brief Owns a read-only mapping of a whole file; unmaps it on
+destruction. */
+class MmapRegion {
+public:
+    void *addr;
+    size_t len;
+
+    MmapRegion(std::string const &fname);
+    ~MmapRegion();
+
+    MmapRegion(MmapRegion const &) = delete;
+    void operator=(MmapRegion const &) = delete;
+};
+
+inline MmapRegion::MmapRegion(std::string const &fname) : addr(0), len(0)
+{
+    int fd = ::open(fname.c_str(), O_RDONLY);
+    if (fd < 0) (*spsparse_error)(-1,
+        "Cannot open %s: %s", fname.c_str(), strerror(errno));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        (*spsparse_error)(-1, "Cannot stat %s: %s", fname.c_str(), strerror(errno));
+    }
+    len = st.st_size;
+    if (len > 0) {
+        addr = mmap(0, len, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            addr = 0;
+            ::close(fd);
+            (*spsparse_error)(-1, "Cannot mmap %s: %s", fname.c_str(), strerror(errno));
+        }
+    }
+    ::close(fd);    // The mapping stays valid
+}
+
+inline MmapRegion::~MmapRegion()
+    { if (addr) munmap(addr, len); }
+
+/** Rounds up to the next section boundary in an MmapCooArray file. */
+inline size_t mmap_align(size_t n)
+    { return (n + 63) & ~(size_t)63; }
+// -----------------------------------------------------
+/** @brief Sparse array in COO format, stored by column, that can be
+backed by a memory-mapped file.
+
+An MmapCooArray opened from a file is read-only: it has the same
+index(dim,ix), val(ix), iterator and dim_beginnings_xiter() surface
+as VectorCooArray, but add() fails.  Arrays made with new_blank() (or
+the shape constructor) are held on the heap and may be added to; so
+Consolidate works on an MmapCooArray in any sort order.
+
+Copies share the mapping.
+@see spsparse::MmapCooArray::write() */
+template<class IndexT, class ValT, int RANK>
+class MmapCooArray
+{
+public:
+    static const int rank = RANK;
+    typedef IndexT index_type;
+    typedef ValT val_type;
+    typedef std::array<index_type, rank> indices_type;
+
+    std::array<size_t, RANK> shape;     // Extent of each dimension
+    void set_shape(std::array<size_t, RANK> const &_shape) { shape = _shape; }
+
+protected:
+    typedef MmapCooArray<IndexT, ValT, RANK> ThisMmapCooArrayT;
+
+    // The columns: in the mapping, or in the vectors below.
+    std::shared_ptr<MmapRegion> region;
+    std::array<IndexT const *, RANK> index_ptrs;
+    ValT const *val_ptr;
+    size_t _size;
+
+    // Heap storage (if not mapped)
+    std::array<std::vector<IndexT>, RANK> index_vecs;
+    std::vector<ValT> val_vec;
+
+    // dim_beginnings stored in the file (copied out on demand)
+    uint64_t const *file_dim_beginnings;
+    size_t nfile_dim_beginnings;
+
+    bool dim_beginnings_set;
+    std::vector<size_t> _dim_beginnings;
+
+    /** Points the columns at the heap storage. */
+    void repoint();
+
+public:
+    bool edit_mode;     // Are we in edit mode?
+    std::array<int,RANK> sort_order;    // Non-negative elements if this is sorted
+
+    /** Makes an empty heap-backed array. */
+    MmapCooArray();
+
+    MmapCooArray(std::array<size_t, RANK> const &_shape);
+
+    /** @brief Maps a file written by write().
+    It is an error if the file was written with a different rank,
+    index type or value type. */
+    explicit MmapCooArray(std::string const &fname);
+
+    /** @brief Writes any sparse array to fname, in the format read by
+    MmapCooArray(fname).  If A is sorted, its dim_beginnings are
+    written too, so readers don't have to recompute them. */
+    template<class ArrayT>
+    static void write(std::string const &fname, ArrayT const &A);
+
+    std::unique_ptr<ThisMmapCooArrayT> new_blank() const
+        { return std::unique_ptr<ThisMmapCooArrayT>(new ThisMmapCooArrayT(shape)); }
+    ThisMmapCooArrayT make_blank() const
+        { return ThisMmapCooArrayT(shape); }
+
+    // Move semantics
+    MmapCooArray(MmapCooArray &&other);
+    void operator=(ThisMmapCooArrayT &&other);
+
+    // Copy semantics
+    MmapCooArray(MmapCooArray const &other);
+    void operator=(ThisMmapCooArrayT const &other);
+
+    /** True if the columns live in a file mapping. */
+    bool is_mapped() const
+        { return (bool)region; }
+
+    IndexT const &index(int dim, size_t ix) const
+        { return index_ptrs[dim][ix]; }
+    ValT const &val(size_t ix) const
+        { return val_ptr[ix]; }
+
+    std::array<IndexT, RANK> index(int ix) const {
+        std::array<IndexT, RANK> index_ret;
+        for (int k=0; k<RANK; ++k) index_ret[k] = index(k, ix);
+        return index_ret;
+    }
+
+    /** @note Views into the mapping: do not write through them. */
+    blitz::Array<IndexT, 1> indices(int dim) const
+    {
+        return blitz::Array<IndexT, 1>(const_cast<IndexT *>(index_ptrs[dim]),
+            blitz::shape(_size), blitz::neverDeleteData);
+    }
+    blitz::Array<ValT, 1> vals() const
+    {
+        return blitz::Array<ValT, 1>(const_cast<ValT *>(val_ptr),
+            blitz::shape(_size), blitz::neverDeleteData);
+    }
+
+    // -------------------------------------------------
+    size_t size() const
+        { return _size; }
+    void clear();
+    void reserve(size_t size);
+
+    // -------------------------------------------------
+    typedef CooIterator<const std::array<IndexT, RANK>, const IndexT, RANK, const ValT, const ThisMmapCooArrayT> const_iterator;
+
+    const_iterator cbegin(int ix = 0) const
+        { return const_iterator(this, ix); }
+    const_iterator cend(int ix = 0) const
+        { return const_iterator(this, size() + ix); }
+    const_iterator begin(int ix = 0) const
+        { return const_iterator(this, ix); }
+    const_iterator end(int ix = 0) const
+        { return const_iterator(this, size() - ix); }
+
+    typedef DimIndexIter<const IndexT, const ValT, const_iterator> const_dim_iterator;
+
+    const_dim_iterator dim_iter(int dim, int ix) const
+        { return const_dim_iterator(dim, const_iterator(this, ix)); }
+    const_dim_iterator dim_begin(int dim) const
+        { return dim_iter(dim, 0); }
+    const_dim_iterator dim_end(int dim) const
+        { return dim_iter(dim, size()); }
+
+    // -------------------------------------------------
+    /** Appends an element; only legal on a heap-backed array. */
+    void add(std::array<IndexT, RANK> const index, ValT const val);
+
+    /** Mark that this is now in sorted form. */
+    void set_sorted(std::array<int,RANK> _sort_order)
+    {
+        if (_sort_order != sort_order) nfile_dim_beginnings = 0;
+        sort_order = _sort_order;
+        edit_mode = false;
+        dim_beginnings_set = false;
+    }
+
+    /** @param nthreads Threads to use for the scatter (see spsparse::dense_scatter()). */
+    blitz::Array<ValT, RANK> to_dense(double fill_value = 0, int nthreads = 1) const;
+
+    // Sets and returns this->_dim_beginnings
+    std::vector<size_t> const &dim_beginnings() const;
+
+    /** See VectorCooArray::set_dim_beginnings() */
+    void set_dim_beginnings(std::vector<size_t> &&db);
+
+    typedef DimBeginningsXiter<ThisMmapCooArrayT> dim_beginnings_xiter_type;
+    dim_beginnings_xiter_type dim_beginnings_xiter() const;
+};
+
+template<class IndexT, class ValT>
+using MmapCooMatrix = MmapCooArray<IndexT, ValT, 2>;
+
+template<class IndexT, class ValT>
+using MmapCooVector = MmapCooArray<IndexT, ValT, 1>;
+
+// --------------------------- Method Definitions
+template<class IndexT, class ValT, int RANK>
+MmapCooArray<IndexT, ValT, RANK>::
+    MmapCooArray() : val_ptr(0), _size(0),
+        file_dim_beginnings(0), nfile_dim_beginnings(0),
+        dim_beginnings_set(false), edit_mode(true), sort_order()
+    {
+        sort_order[0] = -1;
+        for (int k=0; k<RANK; ++k) shape[k] = -1;   // User must set this later
+        repoint();
+    }
+
+template<class IndexT, class ValT, int RANK>
+MmapCooArray<IndexT, ValT, RANK>::
+    MmapCooArray(std::array<size_t, RANK> const &_shape)
+    : shape(_shape), val_ptr(0), _size(0),
+        file_dim_beginnings(0), nfile_dim_beginnings(0),
+        dim_beginnings_set(false), edit_mode(true), sort_order()
+    {
+        sort_order[0] = -1;
+        repoint();
+    }
+
+template<class IndexT, class ValT, int RANK>
+MmapCooArray<IndexT, ValT, RANK>::
+    MmapCooArray(std::string const &fname)
+    : region(new MmapRegion(fname)),
+        file_dim_beginnings(0), nfile_dim_beginnings(0),
+        dim_beginnings_set(false), edit_mode(false)
+    {
+        char const *base = (char const *)region->addr;
+        if (region->len < sizeof(MmapCooHeader)
+            || strncmp(base, "SPSPCOO1", 8) != 0)
+        {
+            (*spsparse_error)(-1, "%s is not an MmapCooArray file", fname.c_str());
+        }
+
+        MmapCooHeader const &head(*(MmapCooHeader const *)base);
+        if (head.rank != RANK || head.index_bytes != sizeof(IndexT)
+            || head.val_bytes != sizeof(ValT)
+            || (bool)head.val_is_float != std::is_floating_point<ValT>::value)
+        {
+            (*spsparse_error)(-1,
+                "%s holds rank=%d, %d-byte indices, %d-byte %s values; "
+                "expected rank=%d, %d-byte indices, %d-byte %s values",
+                fname.c_str(), head.rank, head.index_bytes, head.val_bytes,
+                head.val_is_float ? "float" : "integer",
+                RANK, (int)sizeof(IndexT), (int)sizeof(ValT),
+                std::is_floating_point<ValT>::value ? "float" : "integer");
+        }
+
+        _size = head.nnz;
+        nfile_dim_beginnings = head.ndim_beginnings;
+
+        size_t off = sizeof(MmapCooHeader);
+        int32_t const *sort_order_p = (int32_t const *)(base + off);
+        off += RANK * sizeof(int32_t);
+        uint64_t const *shape_p = (uint64_t const *)(base + off);
+        off += RANK * sizeof(uint64_t);
+        for (int k=0; k<RANK; ++k) {
+            sort_order[k] = sort_order_p[k];
+            shape[k] = shape_p[k];
+        }
+
+        off = mmap_align(off);
+        for (int k=0; k<RANK; ++k) {
+            index_ptrs[k] = (IndexT const *)(base + off);
+            off = mmap_align(off + _size * sizeof(IndexT));
+        }
+        val_ptr = (ValT const *)(base + off);
+        off = mmap_align(off + _size * sizeof(ValT));
+        file_dim_beginnings = (uint64_t const *)(base + off);
+        off += nfile_dim_beginnings * sizeof(uint64_t);
+
+        if (off > region->len) {
+            (*spsparse_error)(-1, "%s is truncated: %ld bytes, expected %ld",
+                fname.c_str(), (long)region->len, (long)off);
+        }
+    }
+
+template<class IndexT, class ValT, int RANK>
+template<class ArrayT>
+void MmapCooArray<IndexT, ValT, RANK>::write(std::string const &fname, ArrayT const &A)
+{
+    std::ofstream out(fname, std::ios::binary | std::ios::trunc);
+    if (!out) (*spsparse_error)(-1, "Cannot open %s for writing", fname.c_str());
+
+    std::vector<size_t> db;
+    if (A.sort_order[0] >= 0) db = A.dim_beginnings();
+
+    MmapCooHeader head;
+    memcpy(head.magic, "SPSPCOO1", 8);
+    head.rank = RANK;
+    head.index_bytes = sizeof(IndexT);
+    head.val_bytes = sizeof(ValT);
+    head.val_is_float = std::is_floating_point<ValT>::value;
+    head.nnz = A.size();
+    head.ndim_beginnings = db.size();
+
+    std::array<int32_t, RANK> sort_order_out;
+    std::array<uint64_t, RANK> shape_out;
+    for (int k=0; k<RANK; ++k) {
+        sort_order_out[k] = A.sort_order[k];
+        shape_out[k] = A.shape[k];
+    }
+
+    size_t off = 0;
+    auto put = [&out, &off](void const *data, size_t n) {
+        out.write((char const *)data, n);
+        off += n;
+    };
+    auto pad = [&put, &off]() {
+        static const char zeros[64] = {0};
+        put(zeros, mmap_align(off) - off);
+    };
+
+    put(&head, sizeof(head));
+    put(sort_order_out.data(), RANK * sizeof(int32_t));
+    put(shape_out.data(), RANK * sizeof(uint64_t));
+    pad();
+
+    // Write one column at a time, through a small buffer
+    const size_t BUFSIZE = 8192;
+    std::vector<IndexT> ibuf;
+    ibuf.reserve(BUFSIZE);
+    for (int k=0; k<RANK; ++k) {
+        for (auto ii=A.begin(); ii != A.end(); ++ii) {
+            ibuf.push_back((IndexT)ii.index(k));
+            if (ibuf.size() == BUFSIZE) {
+                put(ibuf.data(), ibuf.size() * sizeof(IndexT));
+                ibuf.clear();
+            }
+        }
+        put(ibuf.data(), ibuf.size() * sizeof(IndexT));
+        ibuf.clear();
+        pad();
+    }
+
+    std::vector<ValT> vbuf;
+    vbuf.reserve(BUFSIZE);
+    for (auto ii=A.begin(); ii != A.end(); ++ii) {
+        vbuf.push_back((ValT)ii.val());
+        if (vbuf.size() == BUFSIZE) {
+            put(vbuf.data(), vbuf.size() * sizeof(ValT));
+            vbuf.clear();
+        }
+    }
+    put(vbuf.data(), vbuf.size() * sizeof(ValT));
+    pad();
+
+    std::vector<uint64_t> db_out(db.begin(), db.end());
+    put(db_out.data(), db_out.size() * sizeof(uint64_t));
+
+    out.close();
+    if (!out) (*spsparse_error)(-1, "Error writing %s", fname.c_str());
+}
+
+template<class IndexT, class ValT, int RANK>
+MmapCooArray<IndexT, ValT, RANK>::
+    MmapCooArray(MmapCooArray &&other) :
+        shape(other.shape),
+        region(std::move(other.region)),
+        index_ptrs(other.index_ptrs),
+        val_ptr(other.val_ptr),
+        _size(other._size),
+        index_vecs(std::move(other.index_vecs)),
+        val_vec(std::move(other.val_vec)),
+        file_dim_beginnings(other.file_dim_beginnings),
+        nfile_dim_beginnings(other.nfile_dim_beginnings),
+        dim_beginnings_set(other.dim_beginnings_set),
+        _dim_beginnings(std::move(other._dim_beginnings)),
+        edit_mode(other.edit_mode),
+        sort_order(other.sort_order)
+    { if (!region) repoint(); }
+
+template<class IndexT, class ValT, int RANK>
+    void MmapCooArray<IndexT, ValT, RANK>::operator=(ThisMmapCooArrayT &&other) {
+        shape = other.shape;
+        region = std::move(other.region);
+        index_ptrs = other.index_ptrs;
+        val_ptr = other.val_ptr;
+        _size = other._size;
+        index_vecs = std::move(other.index_vecs);
+        val_vec = std::move(other.val_vec);
+        file_dim_beginnings = other.file_dim_beginnings;
+        nfile_dim_beginnings = other.nfile_dim_beginnings;
+        dim_beginnings_set = other.dim_beginnings_set;
+        _dim_beginnings = std::move(other._dim_beginnings);
+        edit_mode = other.edit_mode;
+        sort_order = other.sort_order;
+        if (!region) repoint();
+    }
+
+template<class IndexT, class ValT, int RANK>
+MmapCooArray<IndexT, ValT, RANK>::
+    MmapCooArray(MmapCooArray const &other) :
+        shape(other.shape),
+        region(other.region),
+        index_ptrs(other.index_ptrs),
+        val_ptr(other.val_ptr),
+        _size(other._size),
+        index_vecs(other.index_vecs),
+        val_vec(other.val_vec),
+        file_dim_beginnings(other.file_dim_beginnings),
+        nfile_dim_beginnings(other.nfile_dim_beginnings),
+        dim_beginnings_set(other.dim_beginnings_set),
+        _dim_beginnings(other._dim_beginnings),
+        edit_mode(other.edit_mode),
+        sort_order(other.sort_order)
+    { if (!region) repoint(); }
+
+template<class IndexT, class ValT, int RANK>
+    void MmapCooArray<IndexT, ValT, RANK>::operator=(ThisMmapCooArrayT const &other) {
+        shape = other.shape;
+        region = other.region;
+        index_ptrs = other.index_ptrs;
+        val_ptr = other.val_ptr;
+        _size = other._size;
+        index_vecs = other.index_vecs;
+        val_vec = other.val_vec;
+        file_dim_beginnings = other.file_dim_beginnings;
+        nfile_dim_beginnings = other.nfile_dim_beginnings;
+        dim_beginnings_set = other.dim_beginnings_set;
+        _dim_beginnings = other._dim_beginnings;
+        edit_mode = other.edit_mode;
+        sort_order = other.sort_order;
+        if (!region) repoint();
+    }
+
+template<class IndexT, class ValT, int RANK>
+void MmapCooArray<IndexT, ValT, RANK>::repoint()
+{
+    for (int k=0; k<RANK; ++k) index_ptrs[k] = index_vecs[k].data();
+    val_ptr = val_vec.data();
+    _size = val_vec.size();
+}
+
+template<class IndexT, class ValT, int RANK>
+void MmapCooArray<IndexT, ValT, RANK>::clear()
+{
+    region.reset();
+    for (int k=0; k<RANK; ++k) index_vecs[k].clear();
+    val_vec.clear();
+    file_dim_beginnings = 0;
+    nfile_dim_beginnings = 0;
+    dim_beginnings_set = false;
+    _dim_beginnings.clear();
+    edit_mode = true;
+    sort_order[0] = -1;
+    repoint();
+}
+
+template<class IndexT, class ValT, int RANK>
+void MmapCooArray<IndexT, ValT, RANK>::reserve(size_t size)
+{
+    if (region) return;
+    for (int k=0; k<RANK; ++k) index_vecs[k].reserve(size);
+    val_vec.reserve(size);
+    repoint();
+}
+
+template<class IndexT, class ValT, int RANK>
+void MmapCooArray<IndexT, ValT, RANK>::add(std::array<IndexT, RANK> const index, ValT const val)
+{
+    if (region) {
+        (*spsparse_error)(-1, "MmapCooArray::add(): array is mapped from a file, and is read-only");
+    }
+    if (!edit_mode) {
+        (*spsparse_error)(-1, "Must be in edit mode to use MmapCooArray::add()");
+    }
+
+    // Check bounds
+    for (int i=0; i<RANK; ++i) {
+        if (index[i] < 0 || index[i] >= shape[i]) {
+            std::ostringstream buf;
+            buf << "Sparse index out of bounds: index=(";
+            for (int j=0; j<RANK; ++j) buf << index[j] << " ";
+            buf << ") vs. shape=(";
+            for (int j=0; j<RANK; ++j) buf << shape[j] << " ";
+            buf << ")";
+            (*spsparse_error)(-1, buf.str().c_str());
+        }
+    }
+
+    for (int i=0; i<RANK; ++i) index_vecs[i].push_back(index[i]);
+    val_vec.push_back(val);
+    repoint();
+}
+
+template<class IndexT, class ValT, int RANK>
+    blitz::Array<ValT, RANK> MmapCooArray<IndexT, ValT, RANK>::to_dense(double fill_value, int nthreads) const
+    {
+        blitz::Array<ValT, RANK> ret(ibmisc::to_tiny<int,size_t,rank>(shape));
+        ret = fill_value;
+        dense_scatter(ret, *this, DuplicatePolicy::ADD, nthreads);
+        return ret;
+    }
+
+template<class IndexT, class ValT, int RANK>
+    // Sets and returns this->_dim_beginnings
+    std::vector<size_t> const &MmapCooArray<IndexT, ValT, RANK>::dim_beginnings() const
+    {
+        // See if we need to compute it; lazy eval
+        if (!dim_beginnings_set) {
+            // Const cast OK here for lazy eval implementation
+            ThisMmapCooArrayT *vthis = const_cast<ThisMmapCooArrayT *>(this);
+            if (nfile_dim_beginnings > 0) {
+                vthis->_dim_beginnings.assign(file_dim_beginnings,
+                    file_dim_beginnings + nfile_dim_beginnings);
+            } else {
+                vthis->_dim_beginnings = spsparse::dim_beginnings(*this);
+            }
+            vthis->dim_beginnings_set = true;
+        }
+        return _dim_beginnings;
+    }
+
+template<class IndexT, class ValT, int RANK>
+    void MmapCooArray<IndexT, ValT, RANK>::set_dim_beginnings(std::vector<size_t> &&db)
+    {
+        if (sort_order[0] < 0) {
+            (*spsparse_error)(-1, "set_dim_beginnings() requires the MmapCooArray is sorted first.");
+        }
+        check_dim_beginnings(db, size());
+        _dim_beginnings = std::move(db);
+        dim_beginnings_set = true;
+    }
+
+template<class IndexT, class ValT, int RANK>
+    DimBeginningsXiter<MmapCooArray<IndexT, ValT, RANK>> MmapCooArray<IndexT, ValT, RANK>::dim_beginnings_xiter() const
+    {
+        auto &db(dim_beginnings());
+        int const index_dim = sort_order[0];
+        int const val_dim = sort_order[1];
+        return DimBeginningsXiter<ThisMmapCooArrayT>(this, index_dim, val_dim, db.begin(), db.end());
+    }
+
+
+// ---------------------------------------------------------------------------
+template<class IndexT, class ValT, int RANK>
+std::ostream &operator<<(std::ostream &os, spsparse::MmapCooArray<IndexT, ValT, RANK> const &A)
+    { return spsparse::_ostream_out_array(os, A); }
+
+/** @} */
+
+}   // Namespace
+#endif  // Guard
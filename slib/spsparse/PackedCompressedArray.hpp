@@ -0,0 +1,570 @@
+/*
+ * IBMisc: Misc. Routines for IceBin (and other code)
+ * Copyright (c) 2013-2016 by Elizabeth Fischer
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPSPARSE_PACKED_COMPRESSED_ARRAY_HPP
+#define SPSPARSE_PACKED_COMPRESSED_ARRAY_HPP
+
+#include <cstdint>
+#include <spsparse/CompressedArray.hpp>
+#include <spsparse/multiply_dense.hpp>
+
+namespace spsparse {
+
+/** @defgroup packed_compressed_array PackedCompressedArray.hpp
+@brief Read-mostly CSR / CSC matrices with compressed minor indices.
+
+Like a CompressedArray, but the minor (column, for CSR) indices of
+each row are stored as LEB128 varints of the gap from the previous
+element in the row (the first element of a row stores its index).
+Regrid matrices are consolidated and clustered, so most gaps fit in
+one byte, instead of the 4 or 8 of a plain index.
+
+Rows are iterated with dim_beginnings_xiter() / sub_xiter(), which
+decode as they go; so PackedCompressedArray works in multiply() and
+join2_xiter(), just like CompressedArray.  Random access with
+index(dim, ix) has to decode from the start of the row, and is slow.
+
+Code Example
+@code
+VectorCooMatrix<int, double> A;
+...
+PackedCsrArray<int, double> Apacked(A);     // Consolidates if needed
+multiply(yaccum, Apacked, x);               // Dense SpMV, decoding as it goes
+@endcode
+
+@{
+*/
+
+/** @brief Appends the LEB128 varint encoding of v to out. */
+inline void varint_encode(std::vector<uint8_t> &out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+/** @brief Decodes one LEB128 varint at p, and advances p past it. */
+inline uint64_t varint_decode(uint8_t const *&p)
+{
+    uint64_t v = *p & 0x7f;
+    for (int shift=7; *p++ & 0x80; shift += 7)
+        v |= (uint64_t)(*p & 0x7f) << shift;
+    return v;
+}
+
+/** @brief Xiter along one row (or column) of a PackedCompressedArray.
+
+Decodes the minor indices as it goes; forward-only. */
+template<class IndexT, class ValT>
+class PackedMinorXiter
+{
+    uint8_t const *p;
+    uint8_t const *end;
+    ValT const *vp;
+    IndexT cur;
+    bool _eof;
+
+public:
+    typedef IndexT value_type;
+
+    PackedMinorXiter(uint8_t const *_p, uint8_t const *_end, ValT const *_vp) :
+        p(_p), end(_end), vp(_vp), cur(0), _eof(_p == _end)
+    {
+        if (!_eof) cur = (IndexT)varint_decode(p);
+    }
+
+    bool eof() { return _eof; }
+
+    IndexT operator*() const { return cur; }
+    ValT val() const { return *vp; }
+
+    void operator++()
+    {
+        if (p == end) {
+            _eof = true;
+            return;
+        }
+        cur += (IndexT)varint_decode(p) + 1;
+        ++vp;
+    }
+};
+
+/** @brief Xiter through the non-empty rows (or columns) of a PackedCompressedArray.
+
+Same interface as spsparse::CompressedRowXiter.
+
+@see spsparse::PackedCompressedArray::dim_beginnings_xiter() */
+template<class PackedArrayT>
+class PackedRowXiter : public STLXiter<typename std::vector<typename PackedArrayT::index_type>::const_iterator>
+{
+public:
+    SPSPARSE_LOCAL_TYPES(PackedArrayT);
+    typedef STLXiter<typename std::vector<index_type>::const_iterator> super;
+
+protected:
+    PackedArrayT const *arr;
+
+public:
+    PackedRowXiter(PackedArrayT const *_arr) :
+        super(_arr->major_indices().begin(), _arr->major_indices().end()),
+        arr(_arr) {}
+
+    /** @brief Iterate along the current row (or column).
+    @param _val_dim Dimension to report via operator*() (ignored; always the minor dimension). */
+    typedef PackedMinorXiter<index_type, val_type> sub_xiter_type;
+    sub_xiter_type sub_xiter(int /*_val_dim*/ = -1)
+        { return arr->row_xiter(this->ii - this->begin); }
+
+    // No val()
+};
+
+/** @brief Forward iterator through all elements of a PackedCompressedArray. */
+template<class PackedArrayT>
+class PackedCooIterator
+{
+public:
+    SPSPARSE_LOCAL_TYPES(PackedArrayT);
+
+protected:
+    PackedArrayT const *parent;
+    size_t row;
+    size_t i;
+    uint8_t const *p;
+    index_type minor;
+
+public:
+    PackedCooIterator(PackedArrayT const *_parent, size_t _i);
+
+    int offset() const { return i; }
+    index_type index(int k) const
+        { return k == PackedArrayT::major_dim ? parent->major_indices()[row] : minor; }
+    indices_type index() const
+    {
+        indices_type ret;
+        ret[PackedArrayT::major_dim] = parent->major_indices()[row];
+        ret[PackedArrayT::minor_dim] = minor;
+        return ret;
+    }
+    indices_type operator*() const
+        { return index(); }
+    val_type val() const
+        { return parent->val(i); }
+
+    PackedCooIterator &operator++();
+    bool operator==(PackedCooIterator const &rhs) const
+        { return i == rhs.i; }
+    bool operator!=(PackedCooIterator const &rhs) const
+        { return i != rhs.i; }
+};
+// -----------------------------------------------------
+/** @brief Rank-2 sparse array stored in compressed row (MAJOR_DIM=0)
+or column (MAJOR_DIM=1) form, with varint-coded minor indices.
+
+Only non-empty rows are stored.  For row r (0 <= r < nmajor()),
+major_indices()[r] is its row number; its values are at offsets
+[dim_beginnings()[r], dim_beginnings()[r+1]), and its packed minor
+indices at byte offsets [byte_beginnings()[r], byte_beginnings()[r+1]).
+
+@see spsparse::PackedCsrArray, spsparse::PackedCscArray */
+template<class IndexT, class ValT, int MAJOR_DIM>
+class PackedCompressedArray
+{
+public:
+    static const int rank = 2;
+    static const int major_dim = MAJOR_DIM;
+    static const int minor_dim = 1 - MAJOR_DIM;
+    typedef IndexT index_type;
+    typedef ValT val_type;
+    typedef std::array<index_type, rank> indices_type;
+
+    std::array<size_t, rank> shape;     // Extent of each dimension
+    void set_shape(std::array<size_t, rank> const &_shape) { shape = _shape; }
+
+protected:
+    typedef PackedCompressedArray<IndexT, ValT, MAJOR_DIM> ThisPackedCompressedArrayT;
+
+    std::vector<IndexT> major_vec;          // Row number of each non-empty row
+    std::vector<size_t> _dim_beginnings;    // Start of each row in val_vec, plus sentinel
+    std::vector<size_t> _byte_beginnings;   // Start of each row in minor_bytes, plus sentinel
+    std::vector<uint8_t> minor_bytes;       // Varint-coded minor indices
+    std::vector<ValT> val_vec;
+    IndexT last_minor;                      // Minor index of the last element added
+
+    /** Adds all of A, consolidated in sort_order. */
+    template<class ArrayT>
+    void _add_consolidated(ArrayT const &A);
+
+public:
+    /** Always {major_dim, minor_dim}: a PackedCompressedArray is always consolidated. */
+    std::array<int, rank> const sort_order;
+
+    PackedCompressedArray();
+
+    PackedCompressedArray(std::array<size_t, rank> const &_shape);
+
+    /** @brief Packs any rank-2 sparse array.
+    A is consolidated (into a temporary) first, if needed. */
+    template<class ArrayT>
+    explicit PackedCompressedArray(ArrayT const &A);
+
+    std::unique_ptr<ThisPackedCompressedArrayT> new_blank() const
+        { return std::unique_ptr<ThisPackedCompressedArrayT>(new ThisPackedCompressedArrayT(shape)); }
+    ThisPackedCompressedArrayT make_blank() const
+        { return ThisPackedCompressedArrayT(shape); }
+
+    // Move semantics
+    PackedCompressedArray(PackedCompressedArray &&other);
+    void operator=(ThisPackedCompressedArrayT &&other);
+
+    // -------------------------------------------------
+    size_t size() const
+        { return val_vec.size(); }
+    /** Number of non-empty rows (or columns). */
+    size_t nmajor() const
+        { return major_vec.size(); }
+    /** Approximate memory used by the array, in bytes. */
+    size_t nbytes() const;
+    void clear();
+    void reserve(size_t size);
+
+    /** @note Decodes from the beginning of the row; prefer iterating
+    with dim_beginnings_xiter(). */
+    IndexT index(int dim, size_t ix) const;
+
+    std::array<IndexT, rank> index(int ix) const {
+        std::array<IndexT, rank> index_ret;
+        for (int k=0; k<rank; ++k) index_ret[k] = index(k, ix);
+        return index_ret;
+    }
+
+    ValT &val(size_t ix)
+        { return val_vec[ix]; }
+    ValT const &val(size_t ix) const
+        { return val_vec[ix]; }
+
+    std::vector<IndexT> const &major_indices() const
+        { return major_vec; }
+    std::vector<uint8_t> const &packed_minor_indices() const
+        { return minor_bytes; }
+    blitz::Array<ValT, 1> vals() const
+        { return ibmisc::to_blitz(val_vec); }
+
+    // -------------------------------------------------
+    typedef PackedCooIterator<ThisPackedCompressedArrayT> const_iterator;
+
+    const_iterator cbegin() const
+        { return const_iterator(this, 0); }
+    const_iterator cend() const
+        { return const_iterator(this, size()); }
+    const_iterator begin() const
+        { return const_iterator(this, 0); }
+    const_iterator end() const
+        { return const_iterator(this, size()); }
+
+    // -------------------------------------------------
+    /** Appends an element.  Elements must be added in sorted order
+    (row major for CSR, column major for CSC), with no duplicates. */
+    void add(std::array<IndexT, rank> const index, ValT const val);
+
+    /** Checks that we are being told we're sorted the way we are. */
+    void set_sorted(std::array<int, rank> const &_sort_order);
+
+    blitz::Array<ValT, rank> to_dense(double fill_value = 0);
+
+    /** Offset of the beginning of each non-empty row (or column) in
+    vals(), plus a sentinel. */
+    std::vector<size_t> const &dim_beginnings() const
+        { return _dim_beginnings; }
+
+    /** Offset of the beginning of each non-empty row (or column) in
+    packed_minor_indices(), plus a sentinel. */
+    std::vector<size_t> const &byte_beginnings() const
+        { return _byte_beginnings; }
+
+    /** Xiter along the r'th non-empty row (or column). */
+    PackedMinorXiter<IndexT, ValT> row_xiter(size_t r) const
+    {
+        return PackedMinorXiter<IndexT, ValT>(
+            minor_bytes.data() + _byte_beginnings[r],
+            minor_bytes.data() + _byte_beginnings[r+1],
+            val_vec.data() + _dim_beginnings[r]);
+    }
+
+    typedef PackedRowXiter<ThisPackedCompressedArrayT> dim_beginnings_xiter_type;
+    dim_beginnings_xiter_type dim_beginnings_xiter() const
+        { return dim_beginnings_xiter_type(this); }
+};
+
+template<class IndexT, class ValT>
+using PackedCsrArray = PackedCompressedArray<IndexT, ValT, 0>;
+
+template<class IndexT, class ValT>
+using PackedCscArray = PackedCompressedArray<IndexT, ValT, 1>;
+
+/** Re-sorted (eg: for a transposed multiply) via a VectorCooArray */
+template<class IndexT, class ValT, int MAJOR_DIM>
+struct resorted_type<PackedCompressedArray<IndexT, ValT, MAJOR_DIM>> {
+    typedef VectorCooArray<IndexT, ValT, 2> type;
+};
+
+// --------------------------- Method Definitions
+template<class PackedArrayT>
+PackedCooIterator<PackedArrayT>::
+    PackedCooIterator(PackedArrayT const *_parent, size_t _i)
+    : parent(_parent), row(0), i(_i), p(0), minor(0)
+    {
+        if (i >= parent->size()) return;
+
+        // Find the row containing i, and decode up to i
+        auto const &db(parent->dim_beginnings());
+        row = (std::upper_bound(db.begin(), db.end(), i) - db.begin()) - 1;
+        p = parent->packed_minor_indices().data() + parent->byte_beginnings()[row];
+        minor = (index_type)varint_decode(p);
+        for (size_t k=db[row]; k<i; ++k) minor += (index_type)varint_decode(p) + 1;
+    }
+
+template<class PackedArrayT>
+PackedCooIterator<PackedArrayT> &PackedCooIterator<PackedArrayT>::operator++()
+    {
+        ++i;
+        if (i >= parent->size()) return *this;
+        if (i == parent->dim_beginnings()[row+1]) {
+            ++row;
+            minor = (index_type)varint_decode(p);
+        } else {
+            minor += (index_type)varint_decode(p) + 1;
+        }
+        return *this;
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+PackedCompressedArray<IndexT, ValT, MAJOR_DIM>::
+    PackedCompressedArray()
+    : _dim_beginnings(1, 0), _byte_beginnings(1, 0), last_minor(0), sort_order({MAJOR_DIM, 1-MAJOR_DIM})
+    {
+        for (int k=0; k<rank; ++k) shape[k] = -1;   // User must set this later
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+PackedCompressedArray<IndexT, ValT, MAJOR_DIM>::
+    PackedCompressedArray(std::array<size_t, rank> const &_shape)
+    : shape(_shape), _dim_beginnings(1, 0), _byte_beginnings(1, 0), last_minor(0), sort_order({MAJOR_DIM, 1-MAJOR_DIM})
+    {}
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+template<class ArrayT>
+PackedCompressedArray<IndexT, ValT, MAJOR_DIM>::
+    PackedCompressedArray(ArrayT const &A)
+    : shape(A.shape), _dim_beginnings(1, 0), _byte_beginnings(1, 0), last_minor(0), sort_order({MAJOR_DIM, 1-MAJOR_DIM})
+    {
+        if (needs_resorted_copy(A, sort_order)) _add_consolidated(resorted_copy(A));
+        else _add_consolidated(A);
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+template<class ArrayT>
+void PackedCompressedArray<IndexT, ValT, MAJOR_DIM>::_add_consolidated(ArrayT const &A)
+    {
+        Consolidate<ArrayT> Acon(&A, sort_order);
+        reserve(Acon().size());
+        copy(*this, Acon());
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+PackedCompressedArray<IndexT, ValT, MAJOR_DIM>::
+    PackedCompressedArray(PackedCompressedArray &&other) :
+        shape(other.shape),
+        major_vec(std::move(other.major_vec)),
+        _dim_beginnings(std::move(other._dim_beginnings)),
+        _byte_beginnings(std::move(other._byte_beginnings)),
+        minor_bytes(std::move(other.minor_bytes)),
+        val_vec(std::move(other.val_vec)),
+        last_minor(other.last_minor),
+        sort_order(other.sort_order) {}
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+    void PackedCompressedArray<IndexT, ValT, MAJOR_DIM>::operator=(ThisPackedCompressedArrayT &&other) {
+        shape = other.shape;
+        major_vec = std::move(other.major_vec);
+        _dim_beginnings = std::move(other._dim_beginnings);
+        _byte_beginnings = std::move(other._byte_beginnings);
+        minor_bytes = std::move(other.minor_bytes);
+        val_vec = std::move(other.val_vec);
+        last_minor = other.last_minor;
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+size_t PackedCompressedArray<IndexT, ValT, MAJOR_DIM>::nbytes() const {
+        return major_vec.size() * sizeof(IndexT)
+            + (_dim_beginnings.size() + _byte_beginnings.size()) * sizeof(size_t)
+            + minor_bytes.size()
+            + val_vec.size() * sizeof(ValT);
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+void PackedCompressedArray<IndexT, ValT, MAJOR_DIM>::clear() {
+        major_vec.clear();
+        _dim_beginnings.clear();
+        _dim_beginnings.push_back(0);
+        _byte_beginnings.clear();
+        _byte_beginnings.push_back(0);
+        minor_bytes.clear();
+        val_vec.clear();
+        last_minor = 0;
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+void PackedCompressedArray<IndexT, ValT, MAJOR_DIM>::reserve(size_t size) {
+        minor_bytes.reserve(size);      // Guess one byte per element
+        val_vec.reserve(size);
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+IndexT PackedCompressedArray<IndexT, ValT, MAJOR_DIM>::index(int dim, size_t ix) const
+    {
+        // Find the row containing ix
+        auto ii(std::upper_bound(_dim_beginnings.begin(), _dim_beginnings.end(), ix));
+        size_t const r = (ii - _dim_beginnings.begin()) - 1;
+        if (dim == major_dim) return major_vec[r];
+
+        auto jj(row_xiter(r));
+        for (size_t k=_dim_beginnings[r]; k<ix; ++k) ++jj;
+        return *jj;
+    }
+
+// ------------------------------------------------------------------------
+template<class IndexT, class ValT, int MAJOR_DIM>
+    void PackedCompressedArray<IndexT, ValT, MAJOR_DIM>::add(std::array<IndexT, rank> const index, ValT const val)
+    {
+        // Check bounds
+        for (int i=0; i<rank; ++i) {
+            if (index[i] < 0 || index[i] >= shape[i]) {
+                (*spsparse_error)(-1,
+                    "Sparse index out of bounds: index=(%ld %ld) vs. shape=(%ld %ld)",
+                    (long)index[0], (long)index[1], shape[0], shape[1]);
+            }
+        }
+
+        IndexT const major = index[MAJOR_DIM];
+        IndexT const minor = index[minor_dim];
+        if (major_vec.size() == 0 || major > major_vec.back()) {
+            // Start a new row: store the index itself
+            major_vec.push_back(major);
+            _dim_beginnings.push_back(size() + 1);
+            varint_encode(minor_bytes, minor);
+            _byte_beginnings.push_back(minor_bytes.size());
+        } else if (major == major_vec.back() && minor > last_minor) {
+            // Continue the current row: store the gap
+            ++_dim_beginnings.back();
+            varint_encode(minor_bytes, minor - last_minor - 1);
+            _byte_beginnings.back() = minor_bytes.size();
+        } else {
+            (*spsparse_error)(-1,
+                "PackedCompressedArray::add(): (%ld %ld) added out of order; "
+                "elements must be added sorted by dimension %d, then %d, without duplicates",
+                (long)index[0], (long)index[1], MAJOR_DIM, minor_dim);
+        }
+
+        last_minor = minor;
+        val_vec.push_back(val);
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+    void PackedCompressedArray<IndexT, ValT, MAJOR_DIM>::set_sorted(std::array<int, rank> const &_sort_order)
+    {
+        if (_sort_order != sort_order) {
+            (*spsparse_error)(-1,
+                "PackedCompressedArray is always sorted {%d,%d}; cannot be sorted {%d,%d}",
+                sort_order[0], sort_order[1], _sort_order[0], _sort_order[1]);
+        }
+    }
+
+template<class IndexT, class ValT, int MAJOR_DIM>
+    blitz::Array<ValT, 2> PackedCompressedArray<IndexT, ValT, MAJOR_DIM>::to_dense(double fill_value)
+    {
+        blitz::Array<ValT, rank> ret(ibmisc::to_tiny<int,size_t,rank>(shape));
+        ret = fill_value;
+        DenseAccum<ThisPackedCompressedArrayT> accum(ret);
+        copy(accum, *this);
+        return ret;
+    }
+
+// ---------------------------------------------------------------------------
+/** @brief (Packed Sparse Matrix) * (Dense Vector)
+
+Same as the spsparse::multiply() in multiply_dense.hpp, but decodes
+the packed minor indices on the fly.  When the product runs along the
+minor dimension (e.g. transpose of a PackedCsrArray), it is computed
+by scattering into y, one add() per element. */
+template<class IndexT, class ValT, int MAJOR_DIM, class AccumulatorT>
+void multiply(
+    AccumulatorT &y,
+    PackedCompressedArray<IndexT, ValT, MAJOR_DIM> const &M,
+    blitz::Array<double,1> const &x,
+    bool handle_nan = false,
+    bool transpose = false);
+
+template<class IndexT, class ValT, int MAJOR_DIM, class AccumulatorT>
+void multiply(
+    AccumulatorT &y,
+    PackedCompressedArray<IndexT, ValT, MAJOR_DIM> const &M,
+    blitz::Array<double,1> const &x,
+    bool handle_nan,
+    bool transpose)
+{
+    int const out_dim = (transpose ? 1 : 0);
+    long const nj = M.shape[1-out_dim];
+    if (x.lbound(0) > 0 || x.ubound(0) < nj-1) {
+        (*spsparse_error)(-1, "x (%d..%d) must cover inner dimension of M (0..%ld)",
+            x.lbound(0), x.ubound(0), nj-1);
+    }
+
+    auto const &major(M.major_indices());
+    if (out_dim == MAJOR_DIM) {
+        // One dot product per row
+        for (size_t r=0; r<M.nmajor(); ++r) {
+            double sum = 0;
+            for (auto jj(M.row_xiter(r)); !jj.eof(); ++jj) {
+                double const val = jj.val() * x(*jj);
+                if (!handle_nan || !(std::isnan(val) || std::isinf(val))) sum += val;
+            }
+            y.add({major[r]}, sum);
+        }
+    } else {
+        // Scatter each row
+        for (size_t r=0; r<M.nmajor(); ++r) {
+            double const xr = x(major[r]);
+            for (auto jj(M.row_xiter(r)); !jj.eof(); ++jj) {
+                double const val = jj.val() * xr;
+                if (!handle_nan || !(std::isnan(val) || std::isinf(val))) y.add({*jj}, val);
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+template<class IndexT, class ValT, int MAJOR_DIM>
+std::ostream &operator<<(std::ostream &os, spsparse::PackedCompressedArray<IndexT, ValT, MAJOR_DIM> const &A)
+    { return spsparse::_ostream_out_array(os, A); }
+
+/** @} */
+
+}   // Namespace
+#endif  // Guard
@@ -20,10 +20,17 @@
 #define SPSPARSE_VECTOR_COOARRAY_HPP
 
 #include <spsparse/array.hpp>
+#include <spsparse/arena.hpp>
 
 namespace spsparse {
 
-template<class IndexT, class ValT, int RANK>
+/** @brief Sparse array in coordinate (COO) format, stored by column.
+
+@tparam AllocT Allocator for the index and value columns (rebound
+    to IndexT for the indices).  Use PoolAllocator (or the
+    PooledVectorCooArray alias) to recycle the storage of temporaries
+    through a per-thread pool. */
+template<class IndexT, class ValT, int RANK, class AllocT = std::allocator<ValT>>
 class VectorCooArray
 {
 public:
@@ -31,6 +38,7 @@ public:
     typedef IndexT index_type;
     typedef ValT val_type;
     typedef std::array<index_type, rank> indices_type;
+    typedef AllocT allocator_type;
 
     std::array<size_t, RANK> shape;     // Extent of each dimension
     void set_shape(std::array<size_t, RANK> const &_shape) { shape = _shape; }
@@ -49,9 +57,11 @@ public:
 #endif
 
 protected:
-    typedef VectorCooArray<IndexT, ValT, RANK> ThisVectorCooArrayT;
-    std::array<std::vector<IndexT>, RANK> index_vecs;
-    std::vector<ValT> val_vec;
+    typedef VectorCooArray<IndexT, ValT, RANK, AllocT> ThisVectorCooArrayT;
+    typedef std::vector<IndexT, typename std::allocator_traits<AllocT>::template rebind_alloc<IndexT>> IndexVecT;
+    typedef std::vector<ValT, typename std::allocator_traits<AllocT>::template rebind_alloc<ValT>> ValVecT;
+    std::array<IndexVecT, RANK> index_vecs;
+    ValVecT val_vec;
 
     // OPTIONAL
     // If sort_order[0] != -1, this is the index of the beginning of
@@ -60,6 +70,23 @@ protected:
     bool dim_beginnings_set;
     std::vector<size_t> _dim_beginnings;
 
+    // Number of leading elements known to be consolidated in
+    // prefix_sort_order (and NaN-free, if prefix_zero_nan).  Elements
+    // added after that form an unsorted tail, which consolidate()
+    // sorts on its own and merges in.
+    size_t consolidated_prefix;
+    std::array<int,RANK> prefix_sort_order;
+    bool prefix_zero_nan;
+
+    void permute_range(size_t begin, std::vector<size_t> &perm);
+    size_t compact_range(size_t begin, size_t end,
+        DuplicatePolicy duplicate_policy, bool zero_nan);
+    void merge_tail(std::array<int, RANK> const &_sort_order,
+        DuplicatePolicy duplicate_policy, bool zero_nan);
+
+    template<class IndexTT, class ValTT, int MAJOR_DIM>
+    friend class CompressedArray;
+
 public:
     bool edit_mode;     // Are we in edit mode?
     std::array<int,RANK> sort_order;    // Non-negative elements if this is sorted
@@ -153,38 +180,80 @@ public:
     {
         edit_mode = true;
         sort_order[0] = -1;
+        dim_beginnings_set = false;
     }
 
     void add(std::array<IndexT, RANK> const index, ValT const val);
     void add_blitz(blitz::TinyVector<IndexT, RANK> const &index, ValT const val);
 
+    /** Appends n elements at once, given one contiguous column per
+    dimension, plus the values.  Bounds are checked with a single
+    min/max pass over each column; then each column is appended with
+    one resize and copy. */
+    void add_bulk(std::array<IndexT const *, RANK> const &indices, ValT const *vals, size_t n);
+
+    /** Bulk append from (possibly strided) 1-D Blitz arrays. */
+    void add_bulk(
+        std::array<blitz::Array<IndexT,1>, RANK> const &indices,
+        blitz::Array<ValT,1> const &vals);
+
     /** Mark that this is now in sorted form. */
     void set_sorted(std::array<int,RANK> _sort_order)
     {
         sort_order = _sort_order;
         edit_mode = false;
+        consolidated_prefix = size();
+        prefix_sort_order = _sort_order;
+        prefix_zero_nan = false;
     }
 
     // --------------------------------------------------
     // In-place algos
+
+    /** Sorts and removes duplicates in place (see spsparse::consolidate()).
+
+    Single-threaded, this reorders the existing columns in place.
+    Above the array itself, it needs the permutation vector (8 bytes
+    per element); while the radix sort runs, also the packed keys and
+    one scratch key/permutation pair (see spsparse::radix_sort_keys()).
+    Peak is 24 bytes per element with 32-bit keys, 32 with 64-bit keys.
+    (If the keys do not fit in 64 bits, std::stable_sort() is used,
+    with its own merge buffer.)  With nthreads > 1, it consolidates
+    into a copy and moves that back.
+
+    If the array was consolidated in the same order before more
+    elements were added, only the new elements are sorted; they are
+    then merged into the consolidated prefix in one linear pass.  This
+    assumes the prefix has not been re-indexed through index() or
+    set_index() in the meantime. */
     void consolidate(
         std::array<int, RANK> const &_sort_order,
         DuplicatePolicy duplicate_policy = DuplicatePolicy::ADD,
-        bool handle_nan = false);
+        bool handle_nan = false,
+        int nthreads = 1);
 
     void transpose(std::array<int, RANK> const &sort_order)
     {
-        std::array<std::vector<IndexT>, RANK> new_index_vecs;
+        std::array<IndexVecT, RANK> new_index_vecs;
         for (int k=0; k<RANK; ++k) new_index_vecs[k] = std::move(index_vecs[sort_order[k]]);
         index_vecs = std::move(new_index_vecs);
+        consolidated_prefix = 0;
     }
 
-    blitz::Array<ValT, RANK> to_dense(double fill_value = 0);
+    /** @param nthreads Threads to use for the scatter (see spsparse::dense_scatter()). */
+    blitz::Array<ValT, RANK> to_dense(double fill_value = 0, int nthreads = 1);
 
     // Sets and returns this->_dim_beginnings
     std::vector<size_t> const &dim_beginnings() const;
 
-    DimBeginningsXiter<ThisVectorCooArrayT> dim_beginnings_xiter() const;
+    /** Installs a previously computed dim_beginnings() (eg. one read
+    back from a file), so it is not recomputed.  The array must
+    already be sorted (see set_sorted()); db is checked with
+    spsparse::check_dim_beginnings(). */
+    void set_dim_beginnings(std::vector<size_t> &&db);
+
+    typedef DimBeginningsXiter<ThisVectorCooArrayT> dim_beginnings_xiter_type;
+    dim_beginnings_xiter_type dim_beginnings_xiter() const;
 
     std::ostream &operator<<(std::ostream &out) const;
 };
@@ -192,83 +261,100 @@ public:
 
 
 // --------------------------- Method Definitions
-template<class IndexT, class ValT, int RANK>
-VectorCooArray<IndexT, ValT, RANK>::
-    VectorCooArray() : edit_mode(true), dim_beginnings_set(false), sort_order() {
+template<class IndexT, class ValT, int RANK, class AllocT>
+VectorCooArray<IndexT, ValT, RANK, AllocT>::
+    VectorCooArray() : dim_beginnings_set(false),
+        consolidated_prefix(0), prefix_sort_order(), prefix_zero_nan(false),
+        edit_mode(true), sort_order() {
         sort_order[0] = -1;
         for (int k=0; k<RANK; ++k) shape[k] = -1;   // User must set this later
     }
 
-template<class IndexT, class ValT, int RANK>
-VectorCooArray<IndexT, ValT, RANK>::
+template<class IndexT, class ValT, int RANK, class AllocT>
+VectorCooArray<IndexT, ValT, RANK, AllocT>::
     VectorCooArray(std::array<size_t, RANK> const &_shape)
-    : shape(_shape), edit_mode(true), dim_beginnings_set(false), sort_order() {
+    : shape(_shape), dim_beginnings_set(false),
+        consolidated_prefix(0), prefix_sort_order(), prefix_zero_nan(false),
+        edit_mode(true), sort_order() {
         sort_order[0] = -1;
     }
 
-template<class IndexT, class ValT, int RANK>
-VectorCooArray<IndexT, ValT, RANK>::
+template<class IndexT, class ValT, int RANK, class AllocT>
+VectorCooArray<IndexT, ValT, RANK, AllocT>::
     VectorCooArray(VectorCooArray &&other) :
         shape(other.shape),
         index_vecs(std::move(other.index_vecs)),
         val_vec(std::move(other.val_vec)),
         dim_beginnings_set(other.dim_beginnings_set),
         _dim_beginnings(std::move(other._dim_beginnings)),
+        consolidated_prefix(other.consolidated_prefix),
+        prefix_sort_order(other.prefix_sort_order),
+        prefix_zero_nan(other.prefix_zero_nan),
         edit_mode(other.edit_mode),
         sort_order(other.sort_order) {}
 
-template<class IndexT, class ValT, int RANK>
-    void VectorCooArray<IndexT, ValT, RANK>::operator=(ThisVectorCooArrayT &&other) {
+template<class IndexT, class ValT, int RANK, class AllocT>
+    void VectorCooArray<IndexT, ValT, RANK, AllocT>::operator=(ThisVectorCooArrayT &&other) {
         shape = other.shape;
         index_vecs = std::move(other.index_vecs);
         val_vec = std::move(other.val_vec);
         dim_beginnings_set = other.dim_beginnings_set;
         _dim_beginnings = std::move(other._dim_beginnings);
+        consolidated_prefix = other.consolidated_prefix;
+        prefix_sort_order = other.prefix_sort_order;
+        prefix_zero_nan = other.prefix_zero_nan;
         edit_mode = other.edit_mode;
         sort_order = other.sort_order;
     }
 
-template<class IndexT, class ValT, int RANK>
-VectorCooArray<IndexT, ValT, RANK>::
+template<class IndexT, class ValT, int RANK, class AllocT>
+VectorCooArray<IndexT, ValT, RANK, AllocT>::
     VectorCooArray(VectorCooArray const &other) :
         shape(other.shape),
         index_vecs(other.index_vecs),
         val_vec(other.val_vec),
         dim_beginnings_set(other.dim_beginnings_set),
         _dim_beginnings(other._dim_beginnings),
+        consolidated_prefix(other.consolidated_prefix),
+        prefix_sort_order(other.prefix_sort_order),
+        prefix_zero_nan(other.prefix_zero_nan),
         edit_mode(other.edit_mode),
         sort_order(other.sort_order) {}
 
-template<class IndexT, class ValT, int RANK>
-    void VectorCooArray<IndexT, ValT, RANK>::operator=(ThisVectorCooArrayT const &other) {
+template<class IndexT, class ValT, int RANK, class AllocT>
+    void VectorCooArray<IndexT, ValT, RANK, AllocT>::operator=(ThisVectorCooArrayT const &other) {
         shape = other.shape;
         index_vecs = other.index_vecs;
         val_vec = other.val_vec;
         dim_beginnings_set = other.dim_beginnings_set;
         _dim_beginnings = other._dim_beginnings;
+        consolidated_prefix = other.consolidated_prefix;
+        prefix_sort_order = other.prefix_sort_order;
+        prefix_zero_nan = other.prefix_zero_nan;
         edit_mode = other.edit_mode;
         sort_order = other.sort_order;
     }
 
-template<class IndexT, class ValT, int RANK>
-void VectorCooArray<IndexT, ValT, RANK>::clear() {
+template<class IndexT, class ValT, int RANK, class AllocT>
+void VectorCooArray<IndexT, ValT, RANK, AllocT>::clear() {
         for (int k=0; k<RANK; ++k) index_vecs[k].clear();
         val_vec.clear();
         dim_beginnings_set = false;
         _dim_beginnings.clear();
+        consolidated_prefix = 0;
         edit_mode = true;
         sort_order[0] = -1;
     }
 
-template<class IndexT, class ValT, int RANK>
-void VectorCooArray<IndexT, ValT, RANK>::reserve(size_t size) {
+template<class IndexT, class ValT, int RANK, class AllocT>
+void VectorCooArray<IndexT, ValT, RANK, AllocT>::reserve(size_t size) {
         for (int k=0; k<RANK; ++k) index_vecs[k].reserve(size);
         val_vec.reserve(size);
     }
 
 // ------------------------------------------------------------------------
-template<class IndexT, class ValT, int RANK>
-    void VectorCooArray<IndexT, ValT, RANK>::add(std::array<IndexT, RANK> const index, ValT const val)
+template<class IndexT, class ValT, int RANK, class AllocT>
+    void VectorCooArray<IndexT, ValT, RANK, AllocT>::add(std::array<IndexT, RANK> const index, ValT const val)
     {
         if (!edit_mode) {
             (*spsparse_error)(-1, "Must be in edit mode to use VectorCooArray::add()");
@@ -297,8 +383,8 @@ template<class IndexT, class ValT, int RANK>
         val_vec.push_back(val);
     }
 // ------------------------------------------------------------------------
-template<class IndexT, class ValT, int RANK>
-    void VectorCooArray<IndexT, ValT, RANK>::add_blitz(blitz::TinyVector<IndexT, RANK> const &index, ValT const val)
+template<class IndexT, class ValT, int RANK, class AllocT>
+    void VectorCooArray<IndexT, ValT, RANK, AllocT>::add_blitz(blitz::TinyVector<IndexT, RANK> const &index, ValT const val)
     {
         if (!edit_mode) {
             (*spsparse_error)(-1, "Must be in edit mode to use VectorCooArray::add()");
@@ -326,35 +412,278 @@ template<class IndexT, class ValT, int RANK>
         for (int i=0; i<RANK; ++i) index_vecs[i].push_back(index[i]);
         val_vec.push_back(val);
     }
+// ------------------------------------------------------------------------
+template<class IndexT, class ValT, int RANK, class AllocT>
+    void VectorCooArray<IndexT, ValT, RANK, AllocT>::add_bulk(std::array<IndexT const *, RANK> const &indices, ValT const *vals, size_t n)
+    {
+        if (!edit_mode) {
+            (*spsparse_error)(-1, "Must be in edit mode to use VectorCooArray::add_bulk()");
+        }
+        if (n == 0) return;
+
+        // Check bounds: one (vectorizable) min/max pass per column
+        for (int k=0; k<RANK; ++k) {
+            IndexT const *col = indices[k];
+            IndexT lo = col[0];
+            IndexT hi = col[0];
+            for (size_t i=1; i<n; ++i) {
+                lo = std::min(lo, col[i]);
+                hi = std::max(hi, col[i]);
+            }
+            if (lo >= 0 && (size_t)hi < shape[k]) continue;
+
+            // Error path: report the first offending element
+            for (size_t i=0; i<n; ++i) {
+                if (col[i] < 0 || (size_t)col[i] >= shape[k]) {
+                    std::ostringstream buf;
+                    buf << "Sparse index out of bounds: index=(";
+                    for (int j=0; j<RANK; ++j) {
+                        buf << indices[j][i];
+                        buf << " ";
+                    }
+                    buf << ") vs. shape=(";
+                    for (int j=0; j<RANK; ++j) {
+                        buf << shape[j];
+                        buf << " ";
+                    }
+                    buf << ")";
+                    (*spsparse_error)(-1, buf.str().c_str());
+                }
+            }
+        }
+
+        size_t const n0 = size();
+        for (int k=0; k<RANK; ++k) {
+            index_vecs[k].resize(n0 + n);
+            std::copy(indices[k], indices[k] + n, &index_vecs[k][n0]);
+        }
+        val_vec.resize(n0 + n);
+        std::copy(vals, vals + n, &val_vec[n0]);
+    }
+
+template<class IndexT, class ValT, int RANK, class AllocT>
+    void VectorCooArray<IndexT, ValT, RANK, AllocT>::add_bulk(
+        std::array<blitz::Array<IndexT,1>, RANK> const &indices,
+        blitz::Array<ValT,1> const &vals)
+    {
+        size_t const n = vals.extent(0);
+        for (int k=0; k<RANK; ++k) {
+            if ((size_t)indices[k].extent(0) != n) (*spsparse_error)(-1,
+                "add_bulk(): indices[%d] has extent %d, but vals has %ld",
+                k, indices[k].extent(0), (long)n);
+        }
+
+        // Use the data in place if contiguous; otherwise copy
+        std::array<std::vector<IndexT>, RANK> index_copies;
+        std::array<IndexT const *, RANK> index_ptrs;
+        for (int k=0; k<RANK; ++k) {
+            if (indices[k].stride(0) == 1) {
+                index_ptrs[k] = indices[k].data();
+            } else {
+                index_copies[k].reserve(n);
+                for (size_t i=0; i<n; ++i)
+                    index_copies[k].push_back(indices[k](indices[k].lbound(0) + i));
+                index_ptrs[k] = index_copies[k].data();
+            }
+        }
+
+        std::vector<ValT> val_copy;
+        ValT const *val_ptr = vals.data();
+        if (vals.stride(0) != 1) {
+            val_copy.reserve(n);
+            for (size_t i=0; i<n; ++i) val_copy.push_back(vals(vals.lbound(0) + i));
+            val_ptr = val_copy.data();
+        }
+
+        add_bulk(index_ptrs, val_ptr, n);
+    }
 // ---------------------------------------------------------------
 
-template<class IndexT, class ValT, int RANK>
-void VectorCooArray<IndexT, ValT, RANK>::consolidate(
+/** Applies a permutation to elements [begin, begin+perm.size()):
+element begin+i <-- element perm[i].  Follows one cycle at a time,
+marking finished slots in perm (which is destroyed). */
+template<class IndexT, class ValT, int RANK, class AllocT>
+void VectorCooArray<IndexT, ValT, RANK, AllocT>::permute_range(size_t begin, std::vector<size_t> &perm)
+    {
+        size_t const n = perm.size();
+        for (size_t i=0; i<n; ++i) {
+            if (perm[i] == begin+i) continue;
+
+            std::array<IndexT, RANK> const idx0(index(begin+i));
+            ValT const val0 = val_vec[begin+i];
+            size_t j = begin+i;
+            for (;;) {
+                size_t const k = perm[j-begin];
+                perm[j-begin] = j;
+                if (k == begin+i) break;
+                for (int d=0; d<RANK; ++d) index_vecs[d][j] = index_vecs[d][k];
+                val_vec[j] = val_vec[k];
+                j = k;
+            }
+            set_index(j, idx0);
+            val_vec[j] = val0;
+        }
+    }
+
+/** Compacts sorted elements [begin, end) forward in place, merging
+duplicates and dropping zeros (and NaNs if zero_nan).
+@return End of the compacted range. */
+template<class IndexT, class ValT, int RANK, class AllocT>
+size_t VectorCooArray<IndexT, ValT, RANK, AllocT>::compact_range(size_t begin, size_t end,
+        DuplicatePolicy duplicate_policy, bool zero_nan)
+    {
+        size_t nout = begin;
+        for (size_t i=begin; i<end; ++i) {
+            if (isnone(val_vec[i], zero_nan)) continue;
+
+            if (nout > begin) {
+                bool same = true;
+                for (int d=0; d<RANK; ++d) {
+                    if (index_vecs[d][i] != index_vecs[d][nout-1]) {
+                        same = false;
+                        break;
+                    }
+                }
+                if (same) {
+                    if (duplicate_policy == DuplicatePolicy::ADD)
+                        val_vec[nout-1] += val_vec[i];
+                    else if (duplicate_policy == DuplicatePolicy::REPLACE)
+                        val_vec[nout-1] = val_vec[i];
+                    continue;
+                }
+            }
+
+            for (int d=0; d<RANK; ++d) index_vecs[d][nout] = index_vecs[d][i];
+            val_vec[nout] = val_vec[i];
+            ++nout;
+        }
+        return nout;
+    }
+
+/** Sorts the elements after the consolidated prefix, and merges them
+into it.  Cost is O(t log t) in the length t of the tail, plus one
+linear pass to shift prefix elements over. */
+template<class IndexT, class ValT, int RANK, class AllocT>
+void VectorCooArray<IndexT, ValT, RANK, AllocT>::merge_tail(std::array<int, RANK> const &_sort_order,
+        DuplicatePolicy duplicate_policy, bool zero_nan)
+    {
+        size_t const nprefix = consolidated_prefix;
+        size_t const n = size();
+
+        // Sort and compact the tail on its own
+        size_t tail_end;
+        {
+            std::vector<size_t> perm; perm.reserve(n - nprefix);
+            for (size_t i=nprefix; i<n; ++i) perm.push_back(i);
+            sort_permutation(perm.data(), perm.data() + perm.size(), *this, _sort_order);
+            permute_range(nprefix, perm);
+        }
+        tail_end = compact_range(nprefix, n, duplicate_policy, zero_nan);
+
+        // Key of element i, in sort order
+        auto key_at([&](size_t i) {
+            std::array<IndexT, RANK> key;
+            for (int k=0; k<RANK; ++k) key[k] = index_vecs[_sort_order[k]][i];
+            return key;
+        });
+
+        // Fold tail elements already in the prefix into it; pack the
+        // rest down to [nprefix, tail_new).  Tail keys are increasing,
+        // so each search starts where the last left off.
+        size_t lo = 0;
+        size_t tail_new = nprefix;
+        for (size_t t=nprefix; t<tail_end; ++t) {
+            auto const key(key_at(t));
+            lo += gallop([&](size_t m) { return key_at(lo+m); }, nprefix-lo, key);
+            if (lo < nprefix && key_at(lo) == key) {
+                if (duplicate_policy == DuplicatePolicy::ADD)
+                    val_vec[lo] += val_vec[t];
+                else if (duplicate_policy == DuplicatePolicy::REPLACE)
+                    val_vec[lo] = val_vec[t];
+            } else {
+                for (int d=0; d<RANK; ++d) index_vecs[d][tail_new] = index_vecs[d][t];
+                val_vec[tail_new] = val_vec[t];
+                ++tail_new;
+            }
+        }
+
+        // Merge backward: new elements (copied out) with the prefix
+        size_t const nnew = tail_new - nprefix;
+        std::array<std::vector<IndexT>, RANK> new_index;
+        for (int d=0; d<RANK; ++d) new_index[d].assign(
+            index_vecs[d].begin() + nprefix, index_vecs[d].begin() + tail_new);
+        std::vector<ValT> new_val(val_vec.begin() + nprefix, val_vec.begin() + tail_new);
+        auto new_key_at([&](size_t i) {
+            std::array<IndexT, RANK> key;
+            for (int k=0; k<RANK; ++k) key[k] = new_index[_sort_order[k]][i];
+            return key;
+        });
+
+        size_t p = nprefix;
+        size_t q = nnew;
+        for (size_t w = nprefix + nnew; q > 0; --w) {
+            if (p > 0 && new_key_at(q-1) < key_at(p-1)) {
+                --p;
+                for (int d=0; d<RANK; ++d) index_vecs[d][w-1] = index_vecs[d][p];
+                val_vec[w-1] = val_vec[p];
+            } else {
+                --q;
+                for (int d=0; d<RANK; ++d) index_vecs[d][w-1] = new_index[d][q];
+                val_vec[w-1] = new_val[q];
+            }
+        }
+
+        for (int d=0; d<RANK; ++d) index_vecs[d].resize(nprefix + nnew);
+        val_vec.resize(nprefix + nnew);
+    }
+
+template<class IndexT, class ValT, int RANK, class AllocT>
+void VectorCooArray<IndexT, ValT, RANK, AllocT>::consolidate(
         std::array<int, RANK> const &_sort_order,
         DuplicatePolicy duplicate_policy,
-        bool handle_nan)
+        bool handle_nan,
+        int nthreads)
     {
         // Do nothing if we're already properly consolidated
         if (this->sort_order == _sort_order && !edit_mode) return;
 
-        ThisVectorCooArrayT ret(shape);
-        spsparse::consolidate(ret, *this, _sort_order, duplicate_policy, handle_nan);
-        *this = std::move(ret);
+        if (consolidated_prefix > 0 && prefix_sort_order == _sort_order
+            && (prefix_zero_nan || !handle_nan))
+        {
+            // Only the elements added since the last consolidate need sorting
+            merge_tail(_sort_order, duplicate_policy, handle_nan);
+        } else if (nthreads > 1) {
+            ThisVectorCooArrayT ret(shape);
+            spsparse::consolidate(ret, *this, _sort_order, duplicate_policy, handle_nan, nthreads);
+            *this = std::move(ret);
+            prefix_zero_nan = handle_nan;
+            return;
+        } else {
+            std::vector<size_t> perm(sorted_permutation(*this, _sort_order));
+            permute_range(0, perm);
+            size_t const nout = compact_range(0, size(), duplicate_policy, handle_nan);
+            for (int d=0; d<RANK; ++d) index_vecs[d].resize(nout);
+            val_vec.resize(nout);
+        }
+
+        dim_beginnings_set = false;
+        _dim_beginnings.clear();
+        set_sorted(_sort_order);
+        prefix_zero_nan = handle_nan;
     }
 
-template<class IndexT, class ValT, int RANK>
-    blitz::Array<ValT, RANK> VectorCooArray<IndexT, ValT, RANK>::to_dense(double fill_value)
+template<class IndexT, class ValT, int RANK, class AllocT>
+    blitz::Array<ValT, RANK> VectorCooArray<IndexT, ValT, RANK, AllocT>::to_dense(double fill_value, int nthreads)
     {
         blitz::Array<ValT, RANK> ret(ibmisc::to_tiny<int,size_t,rank>(shape));
         ret = fill_value;
-        DenseAccum<ThisVectorCooArrayT> accum(ret);
-        copy(accum, *this);
+        dense_scatter(ret, *this, DuplicatePolicy::ADD, nthreads);
         return ret;
     }
 
-template<class IndexT, class ValT, int RANK>
+template<class IndexT, class ValT, int RANK, class AllocT>
     // Sets and returns this->_dim_beginnings
-    std::vector<size_t> const &VectorCooArray<IndexT, ValT, RANK>::dim_beginnings() const
+    std::vector<size_t> const &VectorCooArray<IndexT, ValT, RANK, AllocT>::dim_beginnings() const
     {
         // See if we need to compute it; lazy eval
         if (!dim_beginnings_set) {
@@ -366,8 +695,19 @@ template<class IndexT, class ValT, int RANK>
         return _dim_beginnings;
     }
 
-template<class IndexT, class ValT, int RANK>
-    DimBeginningsXiter <VectorCooArray<IndexT, ValT, RANK>> VectorCooArray<IndexT, ValT, RANK>::dim_beginnings_xiter() const
+template<class IndexT, class ValT, int RANK, class AllocT>
+    void VectorCooArray<IndexT, ValT, RANK, AllocT>::set_dim_beginnings(std::vector<size_t> &&db)
+    {
+        if (sort_order[0] < 0) {
+            (*spsparse_error)(-1, "set_dim_beginnings() requires the VectorCooArray is sorted first.");
+        }
+        check_dim_beginnings(db, size());
+        _dim_beginnings = std::move(db);
+        dim_beginnings_set = true;
+    }
+
+template<class IndexT, class ValT, int RANK, class AllocT>
+    DimBeginningsXiter <VectorCooArray<IndexT, ValT, RANK, AllocT>> VectorCooArray<IndexT, ValT, RANK, AllocT>::dim_beginnings_xiter() const
     {
         auto &db(dim_beginnings());
         int const index_dim = sort_order[0];
@@ -377,8 +717,8 @@ template<class IndexT, class ValT, int RANK>
 
 
 // ---------------------------------------------------------------------------
-template<class IndexT, class ValT, int RANK>
-std::ostream &operator<<(std::ostream &os, spsparse::VectorCooArray<IndexT, ValT, RANK> const &A)
+template<class IndexT, class ValT, int RANK, class AllocT>
+std::ostream &operator<<(std::ostream &os, spsparse::VectorCooArray<IndexT, ValT, RANK, AllocT> const &A)
     { return spsparse::_ostream_out_array(os, A); }
 
 template<class IndexT, class ValT>
@@ -387,6 +727,16 @@ using VectorCooMatrix = VectorCooArray<IndexT, ValT, 2>;
 template<class IndexT, class ValT>
 using VectorCooVector = VectorCooArray<IndexT, ValT, 1>;
 
+/** VectorCooArray whose columns are recycled through thread_arena() */
+template<class IndexT, class ValT, int RANK>
+using PooledVectorCooArray = VectorCooArray<IndexT, ValT, RANK, PoolAllocator<ValT>>;
+
+template<class IndexT, class ValT>
+using PooledVectorCooMatrix = PooledVectorCooArray<IndexT, ValT, 2>;
+
+template<class IndexT, class ValT>
+using PooledVectorCooVector = PooledVectorCooArray<IndexT, ValT, 1>;
+
 
 }   // Namespace
 #endif  // Guard
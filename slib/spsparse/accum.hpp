@@ -20,10 +20,19 @@
 #define SPSPARSE_ACCUM_HPP
 
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <new>
 #include <array>
 #include <vector>
+#include <sstream>
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#endif
 #include <ibmisc/blitz.hpp>
 #include <spsparse/spsparse.hpp>
+#include <spsparse/algorithm.hpp>
 
 namespace spsparse {
 
@@ -157,7 +166,656 @@ public:
     }
 };
 // -----------------------------------------------------------
+/** @brief Internal helper function for spsparse::dense_scatter().
+
+Applies n values at precomputed offsets from dense.dataZero().  The
+policy is tested once per block, not once per element. */
+template<class ValT>
+inline void dense_scatter_block(ValT *zero,
+    long const *offs, ValT const *vals, size_t n,
+    DuplicatePolicy duplicate_policy)
+{
+    switch(duplicate_policy) {
+        case DuplicatePolicy::LEAVE_ALONE :     // Same as DenseAccum
+            for (size_t i=0; i<n; ++i) {
+                ValT &oval(zero[offs[i]]);
+                if (!std::isnan(oval)) oval = vals[i];
+            }
+        break;
+        case DuplicatePolicy::ADD :
+            for (size_t i=0; i<n; ++i) zero[offs[i]] += vals[i];
+        break;
+        case DuplicatePolicy::REPLACE :
+            for (size_t i=0; i<n; ++i) zero[offs[i]] = vals[i];
+        break;
+    }
+}
+
+#if defined(__AVX512F__)
+/** @brief AVX-512 version of spsparse::dense_scatter_block(), for double.
+
+REPLACE scatters 8 at a time: scatters to the same address are done in
+lane order, so the last value wins, as in the scalar loop.  ADD does a
+gather / add / scatter, if AVX512CD shows no two lanes share an
+offset; otherwise that vector is done one element at a time. */
+inline void dense_scatter_block(double *zero,
+    long const *offs, double const *vals, size_t n,
+    DuplicatePolicy duplicate_policy)
+{
+    size_t i = 0;
+    switch(duplicate_policy) {
+        case DuplicatePolicy::REPLACE :
+            for (; i+8 <= n; i += 8) {
+                _mm512_i64scatter_pd(zero, _mm512_loadu_si512(offs + i),
+                    _mm512_loadu_pd(vals + i), 8);
+            }
+        break;
+#if defined(__AVX512CD__)
+        case DuplicatePolicy::ADD :
+            for (; i+8 <= n; i += 8) {
+                __m512i const vo = _mm512_loadu_si512(offs + i);
+                __m512i const conflicts = _mm512_conflict_epi64(vo);
+                if (_mm512_test_epi64_mask(conflicts, conflicts)) {
+                    for (size_t j=i; j<i+8; ++j) zero[offs[j]] += vals[j];
+                } else {
+                    __m512d const old = _mm512_i64gather_pd(vo, zero, 8);
+                    _mm512_i64scatter_pd(zero, vo,
+                        _mm512_add_pd(old, _mm512_loadu_pd(vals + i)), 8);
+                }
+            }
+        break;
+#endif
+        default : break;
+    }
+    dense_scatter_block<double>(zero, offs + i, vals + i, n - i, duplicate_policy);
+}
+#endif
+
+/** @brief Internal helper function for spsparse::dense_scatter().
+
+Scatters elements [i0, i1) of A whose dimension-0 index is in
+[row0, row1), in order. */
+template<class VectorCooArrayT>
+void dense_scatter_range(
+    typename VectorCooArrayT::val_type *zero,
+    std::array<long, VectorCooArrayT::rank> const &stride,
+    VectorCooArrayT const &A,
+    size_t i0, size_t i1,
+    long row0, long row1,
+    DuplicatePolicy duplicate_policy)
+{
+    const int RANK = VectorCooArrayT::rank;
+    typedef typename VectorCooArrayT::index_type IndexT;
+    typedef typename VectorCooArrayT::val_type ValT;
+    const size_t BLOCK = 512;
+
+    std::array<IndexT const *, RANK> idx;
+    for (int k=0; k<RANK; ++k) idx[k] = &A.index(k, 0);
+    ValT const *vals = &A.val(0);
+    bool const all_rows = (row0 <= 0 && row1 >= (long)A.shape[0]);
+
+    long offs[BLOCK];
+    ValT bvals[BLOCK];
+    for (size_t b0=i0; b0<i1; b0 += BLOCK) {
+        size_t const b1 = std::min(i1, b0 + BLOCK);
+        if (all_rows) {
+            // Offsets for the whole block, then scatter straight from vals
+            for (size_t i=b0; i<b1; ++i) {
+                long off = 0;
+                for (int k=0; k<RANK; ++k) off += (long)idx[k][i] * stride[k];
+                offs[i-b0] = off;
+            }
+            dense_scatter_block(zero, offs, vals + b0, b1 - b0, duplicate_policy);
+        } else {
+            // Only this thread's rows
+            size_t nb = 0;
+            for (size_t i=b0; i<b1; ++i) {
+                long const row = idx[0][i];
+                if (row < row0 || row >= row1) continue;
+                long off = 0;
+                for (int k=0; k<RANK; ++k) off += (long)idx[k][i] * stride[k];
+                offs[nb] = off;
+                bvals[nb] = vals[i];
+                ++nb;
+            }
+            dense_scatter_block(zero, offs, bvals, nb, duplicate_policy);
+        }
+    }
+}
+
+/** @brief Fast equivalent of copy(DenseAccum(dense, duplicate_policy), A).
+
+Offsets into dense are computed from its strides in blocks, and the
+duplicate policy is tested once per block.  With AVX-512, blocks are
+written with SIMD scatters (see spsparse::dense_scatter_block()).
+Elements with the same index are always applied in the order they
+appear in A, so results are identical to DenseAccum.
+
+A must store its columns contiguously (eg: VectorCooArray,
+MmapCooArray); dense must cover A.shape.
+
+@param nthreads If > 1, dimension 0 of dense is split into that many
+    slices, each written by its own thread.  If A is sorted by
+    dimension 0, each thread takes the matching range of elements;
+    otherwise, each scans all of A for its rows.
+
+Usage Example:
+@code
+VectorCooMatrix<int,double> A;
+blitz::Array<double,2> B(to_tiny(A.shape));
+B = 0;
+dense_scatter(B, A, DuplicatePolicy::ADD, 4);
+@endcode
+*/
+template<class VectorCooArrayT>
+void dense_scatter(
+    blitz::Array<typename VectorCooArrayT::val_type, VectorCooArrayT::rank> &dense,
+    VectorCooArrayT const &A,
+    DuplicatePolicy duplicate_policy = DuplicatePolicy::ADD,
+    int nthreads = 1);
+
+template<class VectorCooArrayT>
+void dense_scatter(
+    blitz::Array<typename VectorCooArrayT::val_type, VectorCooArrayT::rank> &dense,
+    VectorCooArrayT const &A,
+    DuplicatePolicy duplicate_policy,
+    int nthreads)
+{
+    const int RANK = VectorCooArrayT::rank;
+    size_t const n = A.size();
+    if (n == 0) return;
+
+    // Check once that A fits, instead of once per element
+    std::array<long, RANK> stride;
+    for (int k=0; k<RANK; ++k) {
+        if (dense.lbound(k) > 0 || (long)dense.ubound(k) < (long)A.shape[k] - 1) {
+            (*spsparse_error)(-1,
+                "dense_scatter(): dense array [%d..%d] does not cover shape[%d]=%ld",
+                dense.lbound(k), dense.ubound(k), k, (long)A.shape[k]);
+        }
+        stride[k] = dense.stride(k);
+    }
+    auto * const zero = dense.dataZero();
+
+    if (nthreads <= 1) {
+        dense_scatter_range(zero, stride, A, 0, n, 0, A.shape[0], duplicate_policy);
+        return;
+    }
+
+    run_threads(nthreads, [&](int tid) {
+        long const row0 = slice_begin(A.shape[0], nthreads, tid);
+        long const row1 = slice_begin(A.shape[0], nthreads, tid+1);
+        if (A.sort_order[0] == 0) {
+            // Sorted by row: our rows are one contiguous range of elements
+            auto const *rows = &A.index(0, 0);
+            size_t const i0 = std::lower_bound(rows, rows + n, row0) - rows;
+            size_t const i1 = std::lower_bound(rows + i0, rows + n, row1) - rows;
+            dense_scatter_range(zero, stride, A, i0, i1, 0, A.shape[0], duplicate_policy);
+        } else {
+            dense_scatter_range(zero, stride, A, 0, n, row0, row1, duplicate_policy);
+        }
+    });
+}
+// -----------------------------------------------------------
+/** @brief Merges duplicates as they are added, without sorting.
+
+Keeps one entry per distinct index in an open-addressing hash table,
+applying duplicate_policy on the fly; so it gives the same result as
+spsparse::consolidate(), at O(1) per element instead of a sort.  The
+index tuple is packed into a 64-bit key (see
+spsparse::RadixKeyLayout); if it does not fit, a hash of the tuple is
+used instead, and colliding tuples are compared in full.
+
+Entries are emitted in the order their index was first seen; or, if
+needed, sorted at the end with emit_sorted().  As in consolidate(),
+zero (and with zero_nan, NaN) values are dropped when added.
+
+Usage Example:
+@code
+VectorCooMatrix<int,double> A;
+HashAccum<decltype(A)> hash(A.shape);
+copy(hash, A);                  // Duplicates summed here
+
+VectorCooMatrix<int,double> B(A.shape);
+hash.emit_sorted(B, {0,1});     // Same as consolidate(B, A, {0,1})
+@endcode
+*/
+template<class VectorCooArrayT>
+class HashAccum
+{
+public:
+    SPSPARSE_LOCAL_TYPES(VectorCooArrayT);
+    std::array<size_t, rank> shape;
+
+private:
+    static const uint32_t EMPTY = (uint32_t)-1;
+
+    DuplicatePolicy duplicate_policy;
+    bool zero_nan;
+    RadixKeyLayout<rank> layout;
+
+    // Entry number held in each slot (or EMPTY).  Slots are kept
+    // small so the table stays in cache; keys and values live with
+    // the entries.
+    std::vector<uint32_t> slots;        // Size is a power of 2
+    int slot_bits;
+
+    // One entry per distinct index, in the order first seen
+    struct Entry {
+        uint64_t key;
+        val_type val;
+    };
+    std::vector<Entry> entries;
+    std::array<std::vector<index_type>, rank> index_vecs;
+
+    static std::array<int, rank> natural_order() {
+        std::array<int, rank> ret;
+        for (int k=0; k<rank; ++k) ret[k] = k;
+        return ret;
+    }
+    uint64_t key_of(indices_type const &index) const;
+    /** Scatters keys by their high bits, but keeps keys that differ
+    only in the low bits (nearby columns of the same row) in nearby
+    slots: input usually arrives with that locality. */
+    size_t slot_of(uint64_t key) const {
+        const int LOW_BITS = 6;
+        return (size_t)((((key >> LOW_BITS) * 0x9E3779B97F4A7C15ull) >> (64 - slot_bits))
+            + (key & (((uint64_t)1 << LOW_BITS) - 1)));
+    }
+    void rehash(int _slot_bits);
+
+public:
+    /** @param _shape Shape of the arrays that will be added.
+    @param _duplicate_policy What to do when an index is seen again (see spsparse::consolidate()).
+    @param _zero_nan If true, treat NaNs as zeros (i.e. drop them).
+    @param expected_size Number of distinct indices expected; the table is sized for this up front. */
+    HashAccum(std::array<size_t, rank> const &_shape,
+        DuplicatePolicy _duplicate_policy = DuplicatePolicy::ADD,
+        bool _zero_nan = false,
+        size_t expected_size = 0);
+
+    /** Changes the shape; only legal while empty. */
+    void set_shape(std::array<size_t, rank> const &_shape);
+
+    void add(indices_type const &index, val_type const &val);
+
+    /** Number of distinct indices seen so far. */
+    size_t size() const
+        { return entries.size(); }
+    index_type index(int dim, size_t ix) const
+        { return index_vecs[dim][ix]; }
+    indices_type index(size_t ix) const {
+        indices_type ret;
+        for (int k=0; k<rank; ++k) ret[k] = index_vecs[k][ix];
+        return ret;
+    }
+    val_type val(size_t ix) const
+        { return entries[ix].val; }
+
+    void clear();
+
+    /** @brief Sends each entry to ret, in the order first seen. */
+    template<class AccumulatorT>
+    void emit(AccumulatorT &ret) const;
+
+    /** @brief Sends each entry to ret in sort_order, and marks ret
+    sorted. */
+    template<class AccumulatorT>
+    void emit_sorted(AccumulatorT &ret, std::array<int, rank> const &sort_order) const;
+};
+
+// -------------------- Method Definitions
+template<class VectorCooArrayT>
+const uint32_t HashAccum<VectorCooArrayT>::EMPTY;
+
+template<class VectorCooArrayT>
+HashAccum<VectorCooArrayT>::
+    HashAccum(std::array<size_t, rank> const &_shape,
+        DuplicatePolicy _duplicate_policy,
+        bool _zero_nan,
+        size_t expected_size)
+    : shape(_shape), duplicate_policy(_duplicate_policy), zero_nan(_zero_nan),
+        layout(_shape, natural_order())
+    {
+        // Keep the load factor at or below 1/2
+        int bits = 4;
+        while (((size_t)1 << bits) < 2 * expected_size) ++bits;
+        rehash(bits);
+    }
+
+template<class VectorCooArrayT>
+void HashAccum<VectorCooArrayT>::set_shape(std::array<size_t, rank> const &_shape)
+{
+    if (size() > 0) (*spsparse_error)(-1,
+        "HashAccum::set_shape(): cannot change shape once elements are added");
+    shape = _shape;
+    layout = RadixKeyLayout<rank>(shape, natural_order());
+}
+
+template<class VectorCooArrayT>
+uint64_t HashAccum<VectorCooArrayT>::key_of(indices_type const &index) const
+{
+    if (layout.fits) return layout.key(index);
+
+    // Doesn't fit: hash the tuple (FNV-1a style)
+    uint64_t ret = 0xcbf29ce484222325ull;
+    for (int k=0; k<rank; ++k) {
+        ret ^= (uint64_t)index[k];
+        ret *= 0x100000001b3ull;
+    }
+    return ret;
+}
+
+template<class VectorCooArrayT>
+void HashAccum<VectorCooArrayT>::rehash(int _slot_bits)
+{
+    slot_bits = _slot_bits;
+    slots.assign((size_t)1 << slot_bits, EMPTY);
+    size_t const mask = slots.size() - 1;
+
+    for (size_t e=0; e<entries.size(); ++e) {
+        size_t s = slot_of(entries[e].key) & mask;
+        while (slots[s] != EMPTY) s = (s + 1) & mask;
+        slots[s] = e;
+    }
+}
+
+template<class VectorCooArrayT>
+void HashAccum<VectorCooArrayT>::add(indices_type const &index, val_type const &val)
+{
+    if (isnone(val, zero_nan)) return;
+
+    // Check bounds: out-of-range indices would alias in the packed key
+    for (int k=0; k<rank; ++k) {
+        if (index[k] < 0 || (size_t)index[k] >= shape[k]) {
+            std::ostringstream buf;
+            buf << "HashAccum::add(): index out of bounds: index=(";
+            for (int j=0; j<rank; ++j) buf << index[j] << " ";
+            buf << ") vs. shape=(";
+            for (int j=0; j<rank; ++j) buf << shape[j] << " ";
+            buf << ")";
+            (*spsparse_error)(-1, buf.str().c_str());
+        }
+    }
+
+    uint64_t const key = key_of(index);
+    size_t const mask = slots.size() - 1;
+    for (size_t s = slot_of(key) & mask; ; s = (s + 1) & mask) {
+        uint32_t const e = slots[s];
+        if (e == EMPTY) {
+            // New index
+            if (entries.size() == EMPTY) (*spsparse_error)(-1,
+                "HashAccum::add(): too many distinct indices");
+            slots[s] = entries.size();
+            entries.push_back(Entry{key, val});
+            for (int k=0; k<rank; ++k) index_vecs[k].push_back(index[k]);
+            if (2 * entries.size() > slots.size()) rehash(slot_bits + 1);
+            return;
+        }
+        Entry &entry(entries[e]);
+        if (entry.key != key) continue;
+        if (!layout.fits) {
+            bool same = true;
+            for (int k=0; k<rank; ++k) same = same && (index_vecs[k][e] == index[k]);
+            if (!same) continue;
+        }
+
+        // Seen before
+        val_type &oval(entry.val);
+        switch(duplicate_policy) {
+            case DuplicatePolicy::LEAVE_ALONE :
+            break;
+            case DuplicatePolicy::ADD :
+                oval += val;
+            break;
+            case DuplicatePolicy::REPLACE :
+                oval = val;
+            break;
+        }
+        return;
+    }
+}
+
+template<class VectorCooArrayT>
+void HashAccum<VectorCooArrayT>::clear()
+{
+    entries.clear();
+    for (int k=0; k<rank; ++k) index_vecs[k].clear();
+    std::fill(slots.begin(), slots.end(), EMPTY);
+}
+
+template<class VectorCooArrayT>
+template<class AccumulatorT>
+void HashAccum<VectorCooArrayT>::emit(AccumulatorT &ret) const
+{
+    for (size_t i=0; i<size(); ++i) ret.add(index(i), val(i));
+}
+
+template<class VectorCooArrayT>
+template<class AccumulatorT>
+void HashAccum<VectorCooArrayT>::emit_sorted(AccumulatorT &ret,
+    std::array<int, rank> const &sort_order) const
+{
+    size_t const n = size();
+    std::vector<size_t> perm; perm.reserve(n);
+    for (size_t i=0; i<n; ++i) perm.push_back(i);
+    sort_permutation(perm.data(), perm.data() + n, *this, sort_order);
+
+    for (auto ii=perm.begin(); ii != perm.end(); ++ii) ret.add(index(*ii), val(*ii));
+    ret.set_sorted(sort_order);
+}
+// -----------------------------------------------------------
+
+
+// -----------------------------------------------------------
+/** @brief STL allocator that honours alignof(T) beyond what
+std::allocator guarantees in C++11 (typically 16 bytes), via
+posix_memalign().  Used for the per-thread slots below. */
+template<class T>
+class AlignedAllocator {
+public:
+    typedef T value_type;
+
+    AlignedAllocator() noexcept {}
+    template<class U>
+    AlignedAllocator(AlignedAllocator<U> const &) noexcept {}
+
+    T *allocate(size_t n)
+    {
+        size_t const align = std::max(alignof(T), sizeof(void *));
+        void *p;
+        if (posix_memalign(&p, align, std::max(n, (size_t)1) * sizeof(T)) != 0)
+            throw std::bad_alloc();
+        return static_cast<T *>(p);
+    }
+
+    void deallocate(T *p, size_t) noexcept
+        { free(p); }
+
+    template<class U>
+    struct rebind { typedef AlignedAllocator<U> other; };
+};
+
+template<class T, class U>
+bool operator==(AlignedAllocator<T> const &, AlignedAllocator<U> const &) { return true; }
+template<class T, class U>
+bool operator!=(AlignedAllocator<T> const &, AlignedAllocator<U> const &) { return false; }
+
+// -----------------------------------------------------------
+/** @brief For many threads producing elements at once.
+
+Each thread appends to its own buffer, obtained with local(tid); no
+locks are taken.  finalize() then appends all buffers to a
+VectorCooArray (or anything with add_bulk()), in order of tid, so the
+result does not depend on thread timing.
+
+Usage Example:
+@code
+VectorCooMatrix<int,double> A(shape);
+ConcurrentCooAccum<decltype(A)> cacc(nthreads);
+run_threads(nthreads, [&](int tid) {
+    auto &accum(cacc.local(tid));
+    ... accum.add({i,j}, val); ...
+});
+cacc.finalize(A);
+@endcode
+*/
+template<class VectorCooArrayT>
+class ConcurrentCooAccum
+{
+public:
+    SPSPARSE_LOCAL_TYPES(VectorCooArrayT);
+
+    /** @brief One thread's append buffer.  Aligned (and so padded)
+    to a cache line, to keep neighbouring threads' buffers apart;
+    locals uses AlignedAllocator so the alignment holds on the heap. */
+    struct alignas(64) Local {
+        static const int rank = VectorCooArrayT::rank;
+        typedef typename VectorCooArrayT::index_type index_type;
+        typedef typename VectorCooArrayT::val_type val_type;
+
+        std::array<std::vector<index_type>, rank> index_vecs;
+        std::vector<val_type> val_vec;
+
+        void add(std::array<index_type, rank> const &index, val_type const &val) {
+            for (int k=0; k<rank; ++k) index_vecs[k].push_back(index[k]);
+            val_vec.push_back(val);
+        }
+        size_t size() const
+            { return val_vec.size(); }
+    };
+
+private:
+    std::vector<Local, AlignedAllocator<Local>> locals;
+
+public:
+    ConcurrentCooAccum(int nthreads) : locals(std::max(nthreads, 1)) {}
+
+    /** Buffer for thread tid; only that thread may add to it. */
+    Local &local(int tid)
+        { return locals[tid]; }
+
+    /** Total number of elements buffered so far. */
+    size_t size() const {
+        size_t ret = 0;
+        for (auto ii=locals.begin(); ii != locals.end(); ++ii) ret += ii->size();
+        return ret;
+    }
+
+    /** @brief Appends everything buffered to ret, and empties the
+    buffers.  Bounds are checked by ret.add_bulk(). */
+    template<class AccumulatorT>
+    void finalize(AccumulatorT &ret);
+};
+
+template<class VectorCooArrayT>
+template<class AccumulatorT>
+void ConcurrentCooAccum<VectorCooArrayT>::finalize(AccumulatorT &ret)
+{
+    ret.reserve(ret.size() + size());
+    for (auto ii=locals.begin(); ii != locals.end(); ++ii) {
+        std::array<index_type const *, rank> indices;
+        for (int k=0; k<rank; ++k) indices[k] = ii->index_vecs[k].data();
+        ret.add_bulk(indices, ii->val_vec.data(), ii->size());
+
+        // Release the memory
+        *ii = Local();
+    }
+}
+// -----------------------------------------------------------
+/** @brief DenseAccum for many threads at once.
+
+Thread 0 adds straight into the output; every other thread adds into
+its own zeroed copy of it.  reduce() sums the copies into the output
+(split across nthreads) and frees them.  Only DuplicatePolicy::ADD is
+meaningful across threads.
+
+Usage Example:
+@code
+blitz::Array<double,2> B(...);
+ParallelDenseAccum<VectorCooMatrix<int,double>> Baccum(B, nthreads);
+run_threads(nthreads, [&](int tid) {
+    auto &accum(Baccum.local(tid));
+    ... accum.add({i,j}, val); ...
+});
+Baccum.reduce();
+@endcode
+*/
+template<class VectorCooArrayT>
+class ParallelDenseAccum
+{
+public:
+    SPSPARSE_LOCAL_TYPES(VectorCooArrayT);
+
+private:
+    int nthreads;
+    blitz_type dense;
+    std::vector<blitz_type> partials;       // One per thread > 0
+
+    // Cache-line aligned, to keep neighbouring threads' accumulators apart
+    struct alignas(64) Local {
+        DenseAccum<VectorCooArrayT> accum;
+    };
+    std::vector<Local, AlignedAllocator<Local>> locals;
+
+public:
+    ParallelDenseAccum(blitz_type &_dense, int _nthreads);
+
+    /** Accumulator for thread tid; only that thread may add to it. */
+    DenseAccum<VectorCooArrayT> &local(int tid)
+        { return locals[tid].accum; }
+
+    /** @brief Adds the other threads' partial sums into the output.
+    Call once all threads are done adding. */
+    void reduce();
+};
+
+template<class VectorCooArrayT>
+ParallelDenseAccum<VectorCooArrayT>::
+    ParallelDenseAccum(blitz_type &_dense, int _nthreads)
+    : nthreads(std::max(_nthreads, 1)), dense(_dense)
+{
+    locals.reserve(nthreads);
+    locals.push_back(Local{DenseAccum<VectorCooArrayT>(dense)});
+    partials.reserve(nthreads-1);
+    for (int tid=1; tid<nthreads; ++tid) {
+        partials.push_back(blitz_type(dense.lbound(), dense.shape()));
+        partials.back() = 0;
+        locals.push_back(Local{DenseAccum<VectorCooArrayT>(partials.back())});
+    }
+}
+
+template<class VectorCooArrayT>
+void ParallelDenseAccum<VectorCooArrayT>::reduce()
+{
+    if (partials.size() == 0) return;
+
+    bool same_layout = dense.isStorageContiguous();
+    for (int k=0; k<rank; ++k) same_layout = same_layout && (dense.stride(k) == partials[0].stride(k));
+
+    if (same_layout) {
+        // Element i of every array is at data()[i]: split the sum by slices
+        size_t const n = dense.numElements();
+        val_type * const out = dense.data();
+        run_threads(nthreads, [&](int tid) {
+            size_t const i0 = slice_begin(n, nthreads, tid);
+            size_t const i1 = slice_begin(n, nthreads, tid+1);
+            for (auto pp=partials.begin(); pp != partials.end(); ++pp) {
+                val_type const * const in = pp->data();
+                for (size_t i=i0; i<i1; ++i) out[i] += in[i];
+            }
+        });
+    } else {
+        for (auto pp=partials.begin(); pp != partials.end(); ++pp) {
+            for (auto ii=pp->begin(); ii != pp->end(); ++ii)
+                dense(ii.position()) += *ii;
+        }
+    }
 
+    // Thread 0's accumulator stays valid; the rest are gone
+    locals.erase(locals.begin() + 1, locals.end());
+    partials.clear();
+}
 
 // -------------------------------------------------------
 /** @brief For inner product.
@@ -20,7 +20,13 @@
 #define SPSPARSE_ALGORITHM_HPP
 
 #include <memory>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
 #include <spsparse/spsparse.hpp>
+#include <spsparse/parallel.hpp>
 #include <spsparse/xiter.hpp>
 
 namespace spsparse {
@@ -74,6 +80,71 @@ void transpose(AccumulatorT &ret, VectorCooArrayT const &A, std::array<int,Vecto
     }
 }
 // -----------------------------------------------------------
+/** @brief Copies a sparse array into one with different (usually
+narrower) index and value types.
+
+For example, to store a regrid matrix with int indices and float
+values, and still multiply in double:
+@code
+VectorCooMatrix<long, double> A;
+VectorCooMatrix<int, float> Af;
+convert(Af, A);
+if (max_relative_error<float>(A) < 1e-6) ...
+@endcode
+
+If ret was empty, it is marked with A's sort order; otherwise A is
+appended and ret is left unsorted.  It is an error if ret's index type
+cannot hold every index in A.shape.
+@param ret Array for output; its shape is set to A.shape.
+@param A Input.
+@see spsparse::max_relative_error() */
+template<class ArrayT, class AccumulatorT>
+void convert(AccumulatorT &ret, ArrayT const &A);
+
+template<class ArrayT, class AccumulatorT>
+void convert(AccumulatorT &ret, ArrayT const &A)
+{
+    typedef typename AccumulatorT::index_type IndexOutT;
+    typedef typename AccumulatorT::val_type ValOutT;
+    const int RANK = ArrayT::rank;
+
+    for (int k=0; k<RANK; ++k) {
+        if (A.shape[k] > 0 && A.shape[k]-1 > (size_t)std::numeric_limits<IndexOutT>::max()) {
+            (*spsparse_error)(-1,
+                "convert(): shape[%d]=%ld does not fit in the output index type", k, (long)A.shape[k]);
+        }
+    }
+
+    // Only an empty ret ends up in A's sort order
+    bool const was_empty = (ret.size() == 0);
+    ret.set_shape(A.shape);
+    typename AccumulatorT::indices_type idx;
+    for (auto ii=A.begin(); ii != A.end(); ++ii) {
+        for (int k=0; k<RANK; ++k) idx[k] = (IndexOutT)ii.index(k);
+        ret.add(idx, (ValOutT)ii.val());
+    }
+    if (was_empty && A.sort_order[0] >= 0) ret.set_sorted(A.sort_order);
+}
+
+/** @brief Largest relative error introduced in any value of A by
+storing it as ValOutT (see spsparse::convert()).
+
+Zero values are skipped.  Values that do not fit in ValOutT give an
+infinite error; NaNs are ignored. */
+template<class ValOutT, class ArrayT>
+double max_relative_error(ArrayT const &A)
+{
+    double ret = 0;
+    for (auto ii=A.begin(); ii != A.end(); ++ii) {
+        double const val = ii.val();
+        if (val == 0 || std::isnan(val)) continue;
+        double const err = std::abs(((double)(ValOutT)val - val) / val);
+        if (std::isnan(err)) return std::numeric_limits<double>::infinity();
+        ret = std::max(ret, err);
+    }
+    return ret;
+}
+// -----------------------------------------------------------
 /** @brief Determines offset of beginning of each row/col (leading sorted dimension) in an array.
 @note The array MUST be sorted properly beforehand, or this will fail.
 
@@ -134,6 +205,78 @@ printf("]\n");
 
     return abegin;
 }
+
+/** @brief Checks that db could have come from dim_beginnings() on an
+array of n elements: strictly increasing offsets, from 0 and ending
+with the sentinel n (or empty, if n == 0).  O(db.size()). */
+inline void check_dim_beginnings(std::vector<size_t> const &db, size_t n)
+{
+    bool ok = (n == 0 ? db.empty() : (db.size() >= 2 && db.front() == 0 && db.back() == n));
+    for (size_t i=1; ok && i<db.size(); ++i) ok = (db[i-1] < db[i]);
+    if (!ok) (*spsparse_error)(-1,
+        "dim_beginnings (length %ld) is not valid for an array of %ld elements",
+        (long)db.size(), (long)n);
+}
+// ----------------------------------------------------------
+/** @brief True if A is consolidated in sort_order: its indices are
+strictly increasing in that order (so no duplicates).
+
+One pass over the index columns; much cheaper than re-sorting.  Does
+not look at A.sort_order.
+
+@param dim_beginnings If non-null, also require that these are exactly
+    the dim_beginnings() of A in sort_order: each entry (before the
+    sentinel) starts a new value of the leading index.  Checked in the
+    same pass. */
+template<class VectorCooArrayT>
+bool is_sorted_by(
+    VectorCooArrayT const &A,
+    std::array<int, VectorCooArrayT::rank> const &sort_order,
+    std::vector<size_t> const *dim_beginnings);
+
+template<class VectorCooArrayT>
+bool is_sorted_by(
+    VectorCooArrayT const &A,
+    std::array<int, VectorCooArrayT::rank> const &sort_order,
+    std::vector<size_t> const *dim_beginnings)
+{
+    const int RANK = VectorCooArrayT::rank;
+    size_t const n = A.size();
+
+    // db[0]=0 and the sentinel db[end]=n; the boundaries in between are
+    // matched against the leading index below.
+    auto const *db = dim_beginnings;
+    if (db) {
+        if (n == 0) return db->empty();
+        if (db->size() < 2 || db->front() != 0 || db->back() != n) return false;
+    }
+    size_t next_db = 1;
+
+    for (size_t i=1; i<n; ++i) {
+        int k=0;
+        for (; k<RANK; ++k) {
+            int const dim = sort_order[k];
+            auto const a = A.index(dim, i-1);
+            auto const b = A.index(dim, i);
+            if (a < b) break;
+            if (b < a) return false;
+        }
+        if (k == RANK) return false;    // Duplicate
+
+        if (db) {
+            bool const new_leading = (k == 0);
+            if (new_leading != ((*db)[next_db] == i)) return false;
+            if (new_leading) ++next_db;
+        }
+    }
+    return !db || next_db == db->size() - 1;
+}
+
+template<class VectorCooArrayT>
+inline bool is_sorted_by(
+    VectorCooArrayT const &A,
+    std::array<int, VectorCooArrayT::rank> const &sort_order)
+{ return is_sorted_by(A, sort_order, (std::vector<size_t> const *)0); }
 // ----------------------------------------------------------
 /** @brief Iterates through a sorted sparse array on a per-row (or column) basis.
 
@@ -194,6 +337,9 @@ class DimBeginningsXiter : public STLXiter<std::vector<size_t>::const_iterator>
 public:
     SPSPARSE_LOCAL_TYPES(VectorCooArrayT);
     typedef std::vector<size_t>::const_iterator DimIterT;
+    /** What operator*() yields (not the size_t offsets we step over),
+    so joins and skip_to() compare indices with indices. */
+    typedef index_type value_type;
 
 protected:
     VectorCooArrayT const *arr;
@@ -217,6 +363,17 @@ public:
     index_type operator*()
         { return arr->index(index_dim, *ii); }
 
+    /** @brief Move forward to the first row (column) >= key, using
+    galloping search.
+    @see spsparse::STLXiter::skip_to() */
+    template<class KeyT>
+    void skip_to(KeyT const &key)
+    {
+        DimIterT const base(ii);
+        ii += gallop([this, &base](size_t n) { return arr->index(index_dim, base[n]); },
+            (end - ii) - 1, key);
+    }
+
     /** @brief Iterate along the current column (if we're scanning row
     major), or row (if we're scanning column major) of the matrix.
 
@@ -251,6 +408,85 @@ template<class VectorCooArrayT>
     }
 
 
+// -----------------------------------------------------
+/** @brief Internal helper function for spsparse::consolidate().
+
+Scans a sorted range of a permutation on A, sending one entry to ret
+for each distinct index.  Zeros (and NaNs, if zero_nan) are skipped.
+@param ii Beginning of the (sorted) permutation range to scan.
+@param end End of the permutation range. */
+template<class VectorCooArrayT, class AccumulatorT, class PermIterT>
+void consolidate_sorted(AccumulatorT &ret,
+    VectorCooArrayT const &A,
+    PermIterT ii, PermIterT const &end,
+    DuplicatePolicy duplicate_policy,
+    bool zero_nan)
+{
+    const int RANK = VectorCooArrayT::rank;
+    typedef typename VectorCooArrayT::index_type IndexT;
+    typedef typename VectorCooArrayT::val_type ValT;
+
+    // Skip over initial 0 and NaN
+    for (;; ++ii) {
+        if (ii == end) return;      // Nothing more to do
+        if (!isnone(A.val(*ii), zero_nan)) break;
+    }
+
+    // New temporary entry
+    std::array<IndexT,RANK> accum_idx(A.index(*ii));
+    ValT accum_val = A.val(*ii);
+    ++ii;
+
+    for (; ; ++ii) {
+        // Skip over initial 0 and NaN
+        for (;; ++ii) {
+            if (ii == end) {
+                // Write out the last thing we had in our accumulator
+                ret.add(accum_idx, accum_val);
+                return;     // Nothing more to do
+            }
+            if (!isnone(A.val(*ii), zero_nan)) break;
+        }
+
+        // Test if A.index(*ii) == accum_idx
+        auto new_idx = A.index(*ii);
+        for (int k=0; k<RANK; ++k) {
+            if (new_idx[k] != accum_idx[k]) {
+                // They don't match.  Write out our accumulator, and reset to this one
+                ret.add(accum_idx, accum_val);
+                accum_idx = new_idx;
+                accum_val = A.val(*ii);
+                goto continue_outer;
+            }
+        }
+
+        // They do match!  Add it into the accumulator...
+        if (duplicate_policy == DuplicatePolicy::ADD)
+            accum_val += A.val(*ii);
+        else if (duplicate_policy == DuplicatePolicy::REPLACE)
+            accum_val = A.val(*ii);
+
+    continue_outer: ;
+    }
+}
+
+/** @brief Internal class used by the multi-threaded spsparse::consolidate().
+
+Accumulator that just remembers what was added, so each thread's
+output can be sent on to the real accumulator in order. */
+template<class VectorCooArrayT>
+struct ConsolidateBuffer {
+    SPSPARSE_LOCAL_TYPES(VectorCooArrayT);
+
+    std::vector<indices_type> indices;
+    std::vector<val_type> vals;
+
+    void add(indices_type const &index, val_type const &val)
+    {
+        indices.push_back(index);
+        vals.push_back(val);
+    }
+};
 // -----------------------------------------------------
 /** @brief Sorts an array and removes duplicates.
 @param ret Accumulator for output.
@@ -258,80 +494,58 @@ template<class VectorCooArrayT>
 @param sort_order Order of dimensions to sort.  Use {0,1} for row major.
 @param duplicate_policy What to do when duplicate entries are encountered (ADD (default), LEAVE_ALONE, REPLACE).
 @param zero_nan If true, treat NaNs as zeros in the matrix (i.e. remove them).  This will prevent NaNs from propagating in computations.
+@param nthreads Number of threads to use.  If >1, entries are split
+    into per-thread buckets by the leading sort dimension, and each
+    bucket is sorted and de-duplicated on its own thread.  Output is
+    identical to the single-threaded version.
 */
 template<class VectorCooArrayT, class AccumulatorT>
 void consolidate(AccumulatorT &ret,
     VectorCooArrayT const &A,
     std::array<int, VectorCooArrayT::rank> const &sort_order,
     DuplicatePolicy duplicate_policy = DuplicatePolicy::ADD,
-    bool zero_nan = false); // Treat NaN like 0
+    bool zero_nan = false,  // Treat NaN like 0
+    int nthreads = 1);
 
 template<class VectorCooArrayT, class AccumulatorT>
 void consolidate(AccumulatorT &ret,
     VectorCooArrayT const &A,
     std::array<int, VectorCooArrayT::rank> const &sort_order,
     DuplicatePolicy duplicate_policy = DuplicatePolicy::ADD,
-    bool zero_nan = false)  // Treat NaN like 0
+    bool zero_nan = false,  // Treat NaN like 0
+    int nthreads = 1)
 {
-    const int RANK = VectorCooArrayT::rank;
-    typedef typename VectorCooArrayT::index_type IndexT;
-    typedef typename VectorCooArrayT::val_type ValT;
-
     // Nothing to do for zero-size matrices
     if (A.size() > 0) {
+        if (nthreads <= 1) {
+            // Get a sorted permutation
+            std::vector<size_t> perm(sorted_permutation(A, sort_order));
 
-        // Get a sorted permutation
-        std::vector<size_t> perm(sorted_permutation(A, sort_order));
-
-        // Scan through to identify duplicates
-        auto ii(perm.begin());
-
-        // Skip over initial 0 and NaN
-        for (;; ++ii) {
-            if (ii == perm.end()) goto finished;        // Nothing more to do
-            if (!isnone(A.val(*ii), zero_nan)) break;
-        }
-
-        // New temporary entry
-        std::array<IndexT,RANK> accum_idx(A.index(*ii));
-        ValT accum_val = A.val(*ii);
-        ++ii;
-
-        for (; ; ++ii) {
-            // Skip over initial 0 and NaN
-            for (;; ++ii) {
-                if (ii == perm.end()) {
-                    // Write out the last thing we had in our accumulator
-                    ret.add(accum_idx, accum_val);
-
-                    goto finished;      // Nothing more to do
-                }
-                if (!isnone(A.val(*ii))) break;
-            }
-
-            // Test if A.index(*ii) == accum_idx
-            auto new_idx = A.index(*ii);
-            for (int k=0; k<RANK; ++k) {
-                if (new_idx[k] != accum_idx[k]) {
-                    // They don't match.  Write out our accumulator, and reset to this one
-                    ret.add(accum_idx, accum_val);
-                    accum_idx = new_idx;
-                    accum_val = A.val(*ii);
-                    goto continue_outer;
-                }
+            // Scan through to identify duplicates
+            consolidate_sorted(ret, A, perm.begin(), perm.end(),
+                duplicate_policy, zero_nan);
+        } else {
+            // Sort into buckets; duplicates always fall in the same bucket
+            std::vector<size_t> bucket_begin;
+            std::vector<size_t> perm(bucketed_sorted_permutation(
+                A, sort_order, nthreads, bucket_begin));
+
+            // Remove duplicates within each bucket
+            std::vector<ConsolidateBuffer<VectorCooArrayT>> buffers(nthreads);
+            run_threads(nthreads, [&](int tid) {
+                consolidate_sorted(buffers[tid], A,
+                    perm.begin() + bucket_begin[tid],
+                    perm.begin() + bucket_begin[tid+1],
+                    duplicate_policy, zero_nan);
+            });
+
+            // Concatenate, in order of buckets
+            for (auto buf=buffers.begin(); buf != buffers.end(); ++buf) {
+                for (size_t i=0; i<buf->vals.size(); ++i)
+                    ret.add(buf->indices[i], buf->vals[i]);
             }
-
-            // They do match!  Add it into the accumulator...
-            if (duplicate_policy == DuplicatePolicy::ADD)
-                accum_val += A.val(*ii);
-            else if (duplicate_policy == DuplicatePolicy::REPLACE)
-                accum_val = A.val(*ii);
-
-        continue_outer: ;
         }
     }
-finished:
-
 
     ret.set_sorted(sort_order);
 }
@@ -351,11 +565,13 @@ public:
     @param sort_order Order of dimensions to sort.  Use {0,1} for row major.
     @param duplicate_policy What to do when duplicate entries are encountered (ADD (default), LEAVE_ALONE, REPLACE).
     @param zero_nan If true, treat NaNs as zeros in the matrix (i.e. remove them).  This will prevent NaNs from propagating in computations.
+    @param nthreads Number of threads to use if A must be consolidated.
     @see spsparse::consolidate() */
     Consolidate(ArrayT const *A,
         std::array<int, ArrayT::rank> const &sort_order,
         DuplicatePolicy duplicate_policy = DuplicatePolicy::ADD,
-        bool zero_nan = false);
+        bool zero_nan = false,
+        int nthreads = 1);
 
     /** @brief Produces the consolidated array.
 
@@ -373,7 +589,8 @@ Consolidate<ArrayT>::
     Consolidate(ArrayT const *A,
         std::array<int, ArrayT::rank> const &sort_order,
         DuplicatePolicy duplicate_policy,
-        bool zero_nan)
+        bool zero_nan,
+        int nthreads)
     {
         if (A->sort_order == sort_order) {
             // A is already consolidated, use it...
@@ -382,10 +599,43 @@ Consolidate<ArrayT>::
             // Must consolidate A...
             A2 = A->new_blank();
             Ap = A2.get();
-            consolidate(*A2, *A, sort_order, duplicate_policy, zero_nan);
+            consolidate(*A2, *A, sort_order, duplicate_policy, zero_nan, nthreads);
         }
     }
 
+// -----------------------------------------------------
+/** @brief Type an ArrayT is copied into when it must be consolidated
+in a sort order it cannot hold.
+
+ArrayT itself for arrays that can be sorted any way.  Arrays that are
+always in one sort order (CompressedArray, PackedCompressedArray)
+specialize this to a VectorCooArray.
+@see spsparse::needs_resorted_copy() */
+template<class ArrayT>
+struct resorted_type {
+    typedef ArrayT type;
+};
+
+/** @brief True if A is of a fixed-order type, and not in sort_order;
+it must then be copied (see spsparse::resorted_copy()) before
+spsparse::Consolidate can put it in sort_order. */
+template<class ArrayT>
+bool needs_resorted_copy(ArrayT const &A,
+    std::array<int, ArrayT::rank> const &sort_order)
+{
+    return !std::is_same<typename resorted_type<ArrayT>::type, ArrayT>::value
+        && A.sort_order != sort_order;
+}
+
+/** @brief Copies A (unsorted) into its resorted_type. */
+template<class ArrayT>
+typename resorted_type<ArrayT>::type resorted_copy(ArrayT const &A)
+{
+    typename resorted_type<ArrayT>::type ret(A.shape);
+    copy(ret, A);
+    return ret;
+}
+
 
 // -------------------------------------------------------------
 // --------------------------------------------------------
@@ -413,10 +663,216 @@ struct CmpIndex {
     }
 };
 // --------------------------------------------------------------------
+/** @brief Internal class used by spsparse::sorted_permutation().
+
+Describes how to pack the index of an element into a single unsigned
+integer key, such that comparing keys is equivalent to comparing
+indices in sort_order.  The number of bits allotted to each dimension
+is bounded by shape.  If the packed index does not fit in 64 bits (or
+the shape has not been set), the layout is marked as not fitting, and
+the caller must sort some other way. */
+template<int RANK>
+struct RadixKeyLayout {
+    std::array<int, RANK> sort_order;
+    std::array<int, RANK> shift;    // Bit offset for dimension sort_order[k]
+    int nbits;                      // Total bits used by the key
+    bool fits;                      // Does the key fit in a uint64_t?
+
+    RadixKeyLayout(
+        std::array<size_t, RANK> const &shape,
+        std::array<int, RANK> const &_sort_order)
+    : sort_order(_sort_order), nbits(0), fits(true)
+    {
+        // Least significant dimension goes in the lowest bits
+        for (int k=RANK-1; k>=0; --k) {
+            size_t const extent = shape[sort_order[k]];
+            if (extent == (size_t)-1) {     // Shape was never set
+                fits = false;
+                return;
+            }
+
+            int bits = 0;
+            for (size_t max_index = (extent > 0 ? extent-1 : 0); max_index != 0; max_index >>= 1) ++bits;
+
+            shift[k] = nbits;
+            nbits += bits;
+        }
+        fits = (nbits <= 64);
+    }
+
+    /** @brief Packed key for element i of A. */
+    template<class VectorCooArrayT>
+    uint64_t key(VectorCooArrayT const &A, size_t i) const
+    {
+        uint64_t ret = 0;
+        for (int k=0; k<RANK; ++k) {
+            if (shift[k] < 64)      // Zero-width dimensions may sit at bit 64
+                ret |= ((uint64_t)A.index(sort_order[k], i)) << shift[k];
+        }
+        return ret;
+    }
+
+    /** @brief Packed key for an index tuple. */
+    template<class IndexT>
+    uint64_t key(std::array<IndexT, RANK> const &index) const
+    {
+        uint64_t ret = 0;
+        for (int k=0; k<RANK; ++k) {
+            if (shift[k] < 64)
+                ret |= ((uint64_t)index[sort_order[k]]) << shift[k];
+        }
+        return ret;
+    }
+};
+
+/** @brief Internal helper for spsparse::radix_sort_permutation().
+
+LSD radix sort of perm[0..n) by packed keys of type KeyT.  Sorts in
+place: passes alternate between (keys, perm) and a single scratch
+(keys2, perm2) pair, so the extra memory is 2*sizeof(KeyT) +
+sizeof(size_t) per element. */
+template<class KeyT, class VectorCooArrayT>
+void radix_sort_keys(
+    size_t *perm, size_t n,
+    RadixKeyLayout<VectorCooArrayT::rank> const &layout,
+    VectorCooArrayT const &A)
+{
+    const int RADIX_BITS = 11;      // 2048 buckets: counts fit in L1 cache
+    const size_t NBUCKETS = (size_t)1 << RADIX_BITS;
+
+    std::vector<KeyT> keys(n);
+    for (size_t i=0; i<n; ++i) keys[i] = (KeyT)layout.key(A, perm[i]);
+    std::vector<KeyT> keys2(n);
+    std::vector<size_t> perm2(n);
+    std::vector<size_t> count(NBUCKETS);
+
+    KeyT *src_k = keys.data();
+    KeyT *dst_k = keys2.data();
+    size_t *src_p = perm;
+    size_t *dst_p = perm2.data();
+    for (int shift=0; shift < layout.nbits; shift += RADIX_BITS) {
+        // Histogram this digit
+        std::fill(count.begin(), count.end(), 0);
+        for (size_t i=0; i<n; ++i) ++count[(src_k[i] >> shift) & (NBUCKETS-1)];
+
+        // Skip the pass if every key has the same digit
+        if (count[(src_k[0] >> shift) & (NBUCKETS-1)] == n) continue;
+
+        // Convert counts to starting offsets
+        size_t total = 0;
+        for (size_t b=0; b<NBUCKETS; ++b) {
+            size_t const c = count[b];
+            count[b] = total;
+            total += c;
+        }
+
+        // Stable scatter by digit
+        for (size_t i=0; i<n; ++i) {
+            size_t const dest = count[(src_k[i] >> shift) & (NBUCKETS-1)]++;
+            dst_k[dest] = src_k[i];
+            dst_p[dest] = src_p[i];
+        }
+        std::swap(src_k, dst_k);
+        std::swap(src_p, dst_p);
+    }
+
+    if (src_p != perm) std::copy(src_p, src_p + n, perm);
+}
+
+/** @brief Internal helper function for spsparse::sorted_permutation().
+
+Stably sorts a range of element numbers of A in place, with an LSD
+radix sort on packed integer keys (see spsparse::RadixKeyLayout).  LSD
+radix sort is stable, so elements that come first in the range remain
+first.  Keys are 32 bits wide when they fit, else 64.
+
+@return false if the keys do not fit, in which case the range is untouched. */
+template<class VectorCooArrayT>
+bool radix_sort_permutation(
+    size_t *perm_begin, size_t *perm_end,
+    VectorCooArrayT const &A,
+    std::array<int, VectorCooArrayT::rank> const &sort_order)
+{
+    RadixKeyLayout<VectorCooArrayT::rank> layout(A.shape, sort_order);
+    if (!layout.fits) return false;
+
+    size_t const n = perm_end - perm_begin;
+    if (n == 0) return true;
+
+    if (layout.nbits <= 32) radix_sort_keys<uint32_t>(perm_begin, n, layout, A);
+    else radix_sort_keys<uint64_t>(perm_begin, n, layout, A);
+    return true;
+}
+
+/** @brief Internal helper function for spsparse::sorted_permutation().
+
+Computes the full sorted permutation of A with an LSD radix sort.
+@return false if the keys do not fit, in which case perm is untouched. */
+template<class VectorCooArrayT>
+bool radix_sorted_permutation(
+    std::vector<size_t> &perm,
+    VectorCooArrayT const &A,
+    std::array<int, VectorCooArrayT::rank> const &sort_order)
+{
+    std::vector<size_t> ret(A.size());
+    for (size_t i=0; i<ret.size(); ++i) ret[i] = i;
+    if (!radix_sort_permutation(ret.data(), ret.data() + ret.size(), A, sort_order))
+        return false;
+    perm = std::move(ret);
+    return true;
+}
+
+/** @brief Internal helper function for spsparse::sorted_permutation().
+Non-integral index types cannot be packed; always use the comparator. */
+template<class VectorCooArrayT>
+inline bool radix_sort_permutation(
+    size_t * /*perm_begin*/, size_t * /*perm_end*/,
+    VectorCooArrayT const & /*A*/,
+    std::array<int, VectorCooArrayT::rank> const & /*sort_order*/,
+    std::false_type /*is_integral*/)
+{ return false; }
+
+template<class VectorCooArrayT>
+inline bool radix_sort_permutation(
+    size_t *perm_begin, size_t *perm_end,
+    VectorCooArrayT const &A,
+    std::array<int, VectorCooArrayT::rank> const &sort_order,
+    std::true_type /*is_integral*/)
+{ return radix_sort_permutation(perm_begin, perm_end, A, sort_order); }
+
+/** @brief Internal helper function for spsparse::sorted_permutation().
+
+Stably sorts a range of element numbers of A.  Uses the radix sort if
+possible, otherwise std::stable_sort() with spsparse::CmpIndex. */
+template<class VectorCooArrayT>
+void sort_permutation(
+    size_t *perm_begin, size_t *perm_end,
+    VectorCooArrayT const &A,
+    std::array<int, VectorCooArrayT::rank> const &sort_order)
+{
+    // Radix sort has overhead not worth paying on tiny ranges
+    const size_t RADIX_MIN_SIZE = 256;
+
+    if ((size_t)(perm_end - perm_begin) >= RADIX_MIN_SIZE && radix_sort_permutation(
+        perm_begin, perm_end, A, sort_order,
+        std::is_integral<typename VectorCooArrayT::index_type>()))
+    { return; }
+
+    // Decide on how we'll sort
+    CmpIndex<VectorCooArrayT> cmp(&A, sort_order);
+    std::stable_sort(perm_begin, perm_end, cmp);
+}
+// --------------------------------------------------------------------
 /** @brief Generates a permutation that, if applied, would result in the array being sorted.
 
+If the index type is integral and the packed index fits in 64 bits
+(see spsparse::RadixKeyLayout), an LSD radix sort is used.
+Otherwise, falls back to std::stable_sort() with spsparse::CmpIndex.
+Both produce the same permutation.
+
 @param A Input array.
 @param sort_order Order of dimensions to sort.  Use {0,1} for row major.
+@param nthreads Number of threads to use (see spsparse::bucketed_sorted_permutation()).
 @return The permutation.
 
 @note Sorting is done in-place.  Elements added first will remain
@@ -424,22 +880,107 @@ struct CmpIndex {
       spsparse::consolidate(). */
 template<class VectorCooArrayT>
 std::vector<size_t> sorted_permutation(VectorCooArrayT const &A,
-    std::array<int, VectorCooArrayT::rank> const &sort_order);
+    std::array<int, VectorCooArrayT::rank> const &sort_order,
+    int nthreads = 1);
 
 template<class VectorCooArrayT>
 std::vector<size_t> sorted_permutation(VectorCooArrayT const &A,
-    std::array<int, VectorCooArrayT::rank> const &sort_order)
+    std::array<int, VectorCooArrayT::rank> const &sort_order,
+    int nthreads)
 {
-    // Decide on how we'll sort
-    CmpIndex<VectorCooArrayT> cmp(&A, sort_order);
+    if (nthreads > 1) {
+        std::vector<size_t> bucket_begin;
+        return bucketed_sorted_permutation(A, sort_order, nthreads, bucket_begin);
+    }
 
     // Generate a permuatation
-    int n = A.size();
+    size_t n = A.size();
     std::vector<size_t> perm; perm.reserve(n);
-    for (int i=0; i<n; ++i) perm.push_back(i);
+    for (size_t i=0; i<n; ++i) perm.push_back(i);
 
     // Sort the permutation
-    std::stable_sort(perm.begin(), perm.end(), cmp);
+    sort_permutation(perm.data(), perm.data() + n, A, sort_order);
+
+    return perm;
+}
+// --------------------------------------------------------------------
+/** @brief Multi-threaded version of spsparse::sorted_permutation().
+
+Splits the range of the leading sort dimension (sort_order[0]) into
+nthreads equal-width buckets.  Element numbers are distributed into
+the buckets (in order, so the sort remains stable), and then each
+bucket is sorted on its own thread.  The resulting permutation is
+identical to the single-threaded one.
+
+@param A Input array.
+@param sort_order Order of dimensions to sort.  Use {0,1} for row major.
+@param nthreads Number of threads (and buckets) to use.
+@param bucket_begin OUTPUT: Offset in the permutation where each
+    bucket begins (nthreads+1 entries, including a sentinel).  Entries
+    with the same index always land in the same bucket.
+@return The permutation. */
+template<class VectorCooArrayT>
+std::vector<size_t> bucketed_sorted_permutation(VectorCooArrayT const &A,
+    std::array<int, VectorCooArrayT::rank> const &sort_order,
+    int nthreads,
+    std::vector<size_t> &bucket_begin);
+
+template<class VectorCooArrayT>
+std::vector<size_t> bucketed_sorted_permutation(VectorCooArrayT const &A,
+    std::array<int, VectorCooArrayT::rank> const &sort_order,
+    int nthreads,
+    std::vector<size_t> &bucket_begin)
+{
+    if (nthreads < 1) nthreads = 1;
+    size_t const n = A.size();
+    int const dim = sort_order[0];      // Dimension we're bucketing by
+
+    // Width of each bucket in the leading dimension
+    size_t extent = A.shape[dim];
+    if (extent == (size_t)-1) {         // Shape not set; use the data
+        extent = 0;
+        for (size_t i=0; i<n; ++i)
+            extent = std::max(extent, (size_t)A.index(dim, i) + 1);
+    }
+    size_t const width = std::max<size_t>(1, (extent + nthreads - 1) / nthreads);
+    auto bucket_of = [&](size_t i) -> size_t
+        { return std::min<size_t>((size_t)A.index(dim, i) / width, nthreads-1); };
+
+    // Count how many elements in each slice of A go in each bucket
+    std::vector<std::vector<size_t>> counts(nthreads, std::vector<size_t>(nthreads, 0));
+    run_threads(nthreads, [&](int tid) {
+        std::vector<size_t> &count(counts[tid]);
+        for (size_t i=slice_begin(n, nthreads, tid); i<slice_begin(n, nthreads, tid+1); ++i)
+            ++count[bucket_of(i)];
+    });
+
+    // Convert counts to offsets: buckets in order, and slices in order
+    // within each bucket (so elements added first remain first)
+    bucket_begin.resize(nthreads+1);
+    size_t total = 0;
+    for (int b=0; b<nthreads; ++b) {
+        bucket_begin[b] = total;
+        for (int tid=0; tid<nthreads; ++tid) {
+            size_t const c = counts[tid][b];
+            counts[tid][b] = total;
+            total += c;
+        }
+    }
+    bucket_begin[nthreads] = total;
+
+    // Distribute into buckets, then sort each bucket
+    std::vector<size_t> perm(n);
+    run_threads(nthreads, [&](int tid) {
+        std::vector<size_t> &offset(counts[tid]);
+        for (size_t i=slice_begin(n, nthreads, tid); i<slice_begin(n, nthreads, tid+1); ++i)
+            perm[offset[bucket_of(i)]++] = i;
+    });
+    run_threads(nthreads, [&](int tid) {
+        if (bucket_begin[tid+1] > bucket_begin[tid]) {
+            sort_permutation(perm.data() + bucket_begin[tid],
+                perm.data() + bucket_begin[tid+1], A, sort_order);
+        }
+    });
 
     return perm;
 }
@@ -0,0 +1,189 @@
+/*
+ * IBMisc: Misc. Routines for IceBin (and other code)
+ * Copyright (c) 2013-2016 by Elizabeth Fischer
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPSPARSE_ARENA_HPP
+#define SPSPARSE_ARENA_HPP
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace spsparse {
+
+/** @defgroup arena arena.hpp
+@brief Per-thread memory pools, to recycle the storage of temporaries.
+
+Consolidating, transposing and multiplying each allocate temporary
+arrays of roughly the same sizes, over and over again (e.g. once per
+coupling timestep).  PoolAllocator keeps freed blocks in a per-thread
+pool, binned by power-of-two size class, and hands them back out on
+the next allocation of that size class.  Each pool holds at most
+max_cached blocks per size class, and max_cached_bytes in total (64 MiB
+by default); raise these on thread_arena() to recycle larger arrays.
+
+Only the pools of long-lived threads are reused from call to call.
+run_threads() starts fresh worker threads on every call, so the pools
+of the workers (tid > 0) die with them: across calls, only
+temporaries made on the calling thread (tid 0) are recycled.
+
+Code Example
+@code
+PooledVectorCooMatrix<int, double> A({nrows, ncols});
+...
+A.consolidate({0,1});    // Temporaries come from (and go back to) the pool
+@endcode
+
+@{
+*/
+
+/** @brief Cache of freed memory blocks, owned by one thread. */
+class ArenaPool {
+public:
+    /** Smallest block handed out is 2^MIN_CLASS bytes */
+    static const int MIN_CLASS = 6;
+    static const int NCLASS = 64;
+
+    /** Maximum number of free blocks kept per size class */
+    size_t max_cached;
+    /** Maximum total bytes kept over all size classes.  Frees beyond
+    either limit go straight back to the system. */
+    size_t max_cached_bytes;
+
+protected:
+    std::array<std::vector<void *>, NCLASS> free_lists;
+    size_t _cached_bytes;
+
+public:
+    ArenaPool(size_t _max_cached = 16, size_t _max_cached_bytes = (size_t)64 << 20)
+        : max_cached(_max_cached), max_cached_bytes(_max_cached_bytes),
+        _cached_bytes(0) {}
+    ~ArenaPool() { release(); }
+
+    /** Size class (log2 of block size) needed to hold nbytes */
+    static int size_class(size_t nbytes)
+    {
+        int cls = MIN_CLASS;
+        while (((size_t)1 << cls) < nbytes && cls < NCLASS-1) ++cls;
+        return cls;
+    }
+
+    void *allocate(size_t nbytes)
+    {
+        int const cls = size_class(nbytes);
+        auto &fl(free_lists[cls]);
+        if (fl.size() > 0) {
+            void *p = fl.back();
+            fl.pop_back();
+            _cached_bytes -= (size_t)1 << cls;
+            return p;
+        }
+        return ::operator new((size_t)1 << cls);
+    }
+
+    void deallocate(void *p, size_t nbytes)
+    {
+        int const cls = size_class(nbytes);
+        size_t const block = (size_t)1 << cls;
+        auto &fl(free_lists[cls]);
+        if (fl.size() < max_cached && _cached_bytes + block <= max_cached_bytes) {
+            fl.push_back(p);
+            _cached_bytes += block;
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    /** Returns all cached blocks to the system. */
+    void release()
+    {
+        for (auto &fl : free_lists) {
+            for (void *p : fl) ::operator delete(p);
+            fl.clear();
+        }
+        _cached_bytes = 0;
+    }
+
+    /** Total bytes currently held in the free lists. */
+    size_t cached_bytes() const
+        { return _cached_bytes; }
+};
+
+/** Set once this thread's pool has been destroyed (at thread exit).
+Blocks freed after that go straight back to the system. */
+inline bool &thread_arena_destroyed()
+{
+    static thread_local bool destroyed = false;
+    return destroyed;
+}
+
+/** @brief The pool behind thread_arena(); flags the thread's pool
+as gone when it is destroyed.  Other ArenaPools leave the flag alone. */
+class ThreadArena : public ArenaPool {
+public:
+    ~ThreadArena() { thread_arena_destroyed() = true; }
+};
+
+/** @brief The calling thread's pool. */
+inline ArenaPool &thread_arena()
+{
+    static thread_local ThreadArena pool;
+    return pool;
+}
+
+/** @brief STL allocator that draws from thread_arena().
+
+Blocks may be freed on a different thread than allocated them; they
+then go to the freeing thread's pool.  All PoolAllocators compare
+equal, so containers using them may be moved and swapped freely. */
+template<class T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+
+    PoolAllocator() noexcept {}
+    template<class U>
+    PoolAllocator(PoolAllocator<U> const &) noexcept {}
+
+    T *allocate(size_t n)
+        { return static_cast<T *>(thread_arena().allocate(n * sizeof(T))); }
+
+    void deallocate(T *p, size_t n) noexcept
+    {
+        if (thread_arena_destroyed()) ::operator delete(p);
+        else thread_arena().deallocate(p, n * sizeof(T));
+    }
+
+    template<class U>
+    struct rebind { typedef PoolAllocator<U> other; };
+};
+
+template<class T, class U>
+bool operator==(PoolAllocator<T> const &, PoolAllocator<U> const &) { return true; }
+template<class T, class U>
+bool operator!=(PoolAllocator<T> const &, PoolAllocator<U> const &) { return false; }
+
+/** @brief std::vector whose storage is recycled through thread_arena(). */
+template<class T>
+using PooledVector = std::vector<T, PoolAllocator<T>>;
+
+/** @} */
+
+}   // Namespace
+#endif  // Guard
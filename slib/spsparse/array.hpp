@@ -80,6 +80,10 @@ public:
 
     DimIndexIter &operator++()
         { ++wrapped; return *this; }
+    DimIndexIter &operator+=(int n)
+        { wrapped += n; return *this; }
+    int operator-(DimIndexIter const &rhs) const
+        { return wrapped - rhs.wrapped; }
     bool operator==(const DimIndexIter& rhs) const
         {return wrapped == rhs.wrapped;}
 };
@@ -118,6 +122,8 @@ public:
 
     CooIterator operator+(int n) const
         { return CooIterator(parent, i+n); }
+    int operator-(CooIterator const &rhs) const
+        { return i - rhs.i; }
     bool operator==(CooIterator const &rhs) const
         { return i == rhs.i; }
     bool operator!=(const CooIterator& rhs) const
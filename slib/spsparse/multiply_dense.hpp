@@ -16,6 +16,25 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifndef SPSPARSE_MULTIPLY_DENSE_HPP
+#define SPSPARSE_MULTIPLY_DENSE_HPP
+
+#include <cmath>
+#include <cstdint>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+/** The AVX2 / AVX-512 kernels are always compiled (with per-function
+target attributes), so they can be tested on any build; but
+sparse_dot() only calls them when the whole build targets that
+instruction set (eg: with USE_NATIVE_ARCH). */
+#define SPSPARSE_SIMD_KERNELS
+#define SPSPARSE_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define SPSPARSE_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#include <blitz/array.h>
+#include <spsparse/multiply_sparse.hpp>
+
+namespace spsparse {
 
 /** @defgroup multiply_dense multiply_dense.hpp
 @brief Multiplication of sparse matrices by dense vectors.
@@ -23,36 +42,336 @@
 @{
 */
 
-#if 0
+// ---------------------------------------------------
+/** @brief Internal helper function for dense multiplication.
+
+Scalar dot product of one compressed row with a dense vector.  If
+handle_nan, non-finite products are left out of the sum. */
+template<class IndexT, class ValT>
+inline double sparse_dot_scalar(
+    IndexT const *cols, ValT const *vals, size_t n,
+    double const *x, bool handle_nan)
+{
+    double sum = 0;
+    if (handle_nan) {
+        for (size_t k=0; k<n; ++k) {
+            double const val = vals[k] * x[cols[k]];
+            if (!(std::isnan(val) || std::isinf(val))) sum += val;
+        }
+    } else {
+        for (size_t k=0; k<n; ++k) sum += vals[k] * x[cols[k]];
+    }
+    return sum;
+}
+
+#ifdef SPSPARSE_SIMD_KERNELS
+SPSPARSE_TARGET_AVX512 inline __m512d gather8_pd(double const *x, int32_t const *cols)
+    { return _mm512_i32gather_pd(_mm256_loadu_si256((__m256i const *)cols), x, 8); }
+SPSPARSE_TARGET_AVX512 inline __m512d gather8_pd(double const *x, int64_t const *cols)
+    { return _mm512_i64gather_pd(_mm512_loadu_si512((void const *)cols), x, 8); }
+SPSPARSE_TARGET_AVX512 inline __m512d load8_pd(double const *vals)
+    { return _mm512_loadu_pd(vals); }
+SPSPARSE_TARGET_AVX512 inline __m512d load8_pd(float const *vals)
+    { return _mm512_cvtps_pd(_mm256_loadu_ps(vals)); }
+
+/** @brief Internal helper function for dense multiplication.
+
+AVX-512 version of sparse_dot_scalar(): gathers 8 elements of x at a
+time.  float values are widened to double before a fused multiply-add
+(with handle_nan, a separate multiply and add, so each product can be
+checked).  Only
+call on CPUs that support AVX-512F. */
+template<class IndexT, class ValT>
+SPSPARSE_TARGET_AVX512 inline double sparse_dot_avx512(
+    IndexT const *cols, ValT const *vals, size_t n,
+    double const *x, bool handle_nan)
+{
+    __m512d const zero = _mm512_setzero_pd();
+    __m512d sum = zero;
+    size_t k=0;
+    for (; k+8 <= n; k += 8) {
+        __m512d const v = load8_pd(vals+k);
+        __m512d const xv = gather8_pd(x, cols+k);
+        if (handle_nan) {
+            // p-p is 0 for finite p, NaN otherwise
+            __m512d const p = _mm512_mul_pd(v, xv);
+            __mmask8 const finite = _mm512_cmp_pd_mask(_mm512_sub_pd(p, p), zero, _CMP_EQ_OQ);
+            sum = _mm512_mask_add_pd(sum, finite, sum, p);
+        } else {
+            sum = _mm512_fmadd_pd(v, xv, sum);
+        }
+    }
+    return _mm512_reduce_add_pd(sum)
+        + sparse_dot_scalar(cols+k, vals+k, n-k, x, handle_nan);
+}
+
+SPSPARSE_TARGET_AVX2 inline __m256d gather4_pd(double const *x, int32_t const *cols)
+    { return _mm256_i32gather_pd(x, _mm_loadu_si128((__m128i const *)cols), 8); }
+SPSPARSE_TARGET_AVX2 inline __m256d gather4_pd(double const *x, int64_t const *cols)
+    { return _mm256_i64gather_pd(x, _mm256_loadu_si256((__m256i const *)cols), 8); }
+SPSPARSE_TARGET_AVX2 inline __m256d load4_pd(double const *vals)
+    { return _mm256_loadu_pd(vals); }
+SPSPARSE_TARGET_AVX2 inline __m256d load4_pd(float const *vals)
+    { return _mm256_cvtps_pd(_mm_loadu_ps(vals)); }
+
+/** @brief Internal helper function for dense multiplication.
+
+AVX2 version of sparse_dot_scalar(): gathers 4 elements of x at a
+time.  float values are widened to double before a fused multiply-add
+(with handle_nan, a separate multiply and add, so each product can be
+checked).  Only
+call on CPUs that support AVX2 and FMA. */
+template<class IndexT, class ValT>
+SPSPARSE_TARGET_AVX2 inline double sparse_dot_avx2(
+    IndexT const *cols, ValT const *vals, size_t n,
+    double const *x, bool handle_nan)
+{
+    __m256d const zero = _mm256_setzero_pd();
+    __m256d sum = zero;
+    size_t k=0;
+    for (; k+4 <= n; k += 4) {
+        __m256d const v = load4_pd(vals+k);
+        __m256d const xv = gather4_pd(x, cols+k);
+        if (handle_nan) {
+            // p-p is 0 for finite p, NaN otherwise
+            __m256d p = _mm256_mul_pd(v, xv);
+            p = _mm256_and_pd(p, _mm256_cmp_pd(_mm256_sub_pd(p, p), zero, _CMP_EQ_OQ));
+            sum = _mm256_add_pd(sum, p);
+        } else {
+            sum = _mm256_fmadd_pd(v, xv, sum);
+        }
+    }
+    __m128d s2 = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+    s2 = _mm_add_sd(s2, _mm_unpackhi_pd(s2, s2));
+    return _mm_cvtsd_f64(s2)
+        + sparse_dot_scalar(cols+k, vals+k, n-k, x, handle_nan);
+}
+#endif
+
+#if defined(SPSPARSE_SIMD_KERNELS) && defined(__AVX512F__)
+template<class IndexT, class ValT>
+inline double sparse_dot_simd(
+    IndexT const *cols, ValT const *vals, size_t n,
+    double const *x, bool handle_nan)
+    { return sparse_dot_avx512(cols, vals, n, x, handle_nan); }
+#elif defined(SPSPARSE_SIMD_KERNELS) && defined(__AVX2__)
+template<class IndexT, class ValT>
+inline double sparse_dot_simd(
+    IndexT const *cols, ValT const *vals, size_t n,
+    double const *x, bool handle_nan)
+    { return sparse_dot_avx2(cols, vals, n, x, handle_nan); }
+#endif
+
+/** @brief Internal helper function for dense multiplication.
+
+Dot product of one compressed row with a dense vector.  Uses gather
+instructions when compiled for AVX2 or AVX-512, and the index and
+value types allow it. */
+template<class IndexT, class ValT>
+inline double sparse_dot(
+    IndexT const *cols, ValT const *vals, size_t n,
+    double const *x, bool handle_nan)
+    { return sparse_dot_scalar(cols, vals, n, x, handle_nan); }
+
+#if defined(SPSPARSE_SIMD_KERNELS) && (defined(__AVX512F__) || defined(__AVX2__))
+inline double sparse_dot(
+    int32_t const *cols, double const *vals, size_t n,
+    double const *x, bool handle_nan)
+    { return sparse_dot_simd(cols, vals, n, x, handle_nan); }
+
+inline double sparse_dot(
+    int64_t const *cols, double const *vals, size_t n,
+    double const *x, bool handle_nan)
+    { return sparse_dot_simd(cols, vals, n, x, handle_nan); }
+
+inline double sparse_dot(
+    int32_t const *cols, float const *vals, size_t n,
+    double const *x, bool handle_nan)
+    { return sparse_dot_simd(cols, vals, n, x, handle_nan); }
+
+inline double sparse_dot(
+    int64_t const *cols, float const *vals, size_t n,
+    double const *x, bool handle_nan)
+    { return sparse_dot_simd(cols, vals, n, x, handle_nan); }
+#endif
+
+// ---------------------------------------------------
+/** @brief (Sparse Matrix) * (Dense Vector)
+
+Computes y += M * x (or transpose(M) * x).  M is consolidated in
+row-major (column-major if transpose) order, and each row is computed
+as one dot product; add() is called once per non-empty row.
+
+Code Example
+@code
+VectorCooMatrix<int, double> M;
+blitz::Array<double,1> x(M.shape[1]);
+blitz::Array<double,1> y(M.shape[0]);
+y = 0;
+DenseAccum<VectorCooVector<int, double>> yaccum(y);
+multiply(yaccum, M, x);
+@endcode
 
-/** (Sparse Matrix) * (Dense Vector) */
-template<class VectorCooMatrixT, class AccumulatorT>
+@param y Accumulator for output.  Its shape is not set.
+@param M Matrix
+@param x Dense vector; must cover indices [0, M.shape[1]).
+@param handle_nan If set, leave out products that are NaN or infinite.
+@param transpose If set, use transpose(M) instead of M.
+*/
+template<class MatT, class AccumulatorT>
 void multiply(
-    VectorCooMatrixT const &M,
-    blitz::Array<double,1> const &x,
     AccumulatorT &y,
+    MatT const &M,
+    blitz::Array<double,1> const &x,
     bool handle_nan = false,
-    bool transpose = false)
+    bool transpose = false);
+
+template<class MatT, class AccumulatorT>
+void multiply(
+    AccumulatorT &y,
+    MatT const &M,
+    blitz::Array<double,1> const &x,
+    bool handle_nan,
+    bool transpose)
 {
-    for (auto ii = M.begin(); ii != M.end(); ++ii) {
-        std::array<IndexT,2> index(ii.index());
-        if (transpose) std::swap(index[0], index[1]);
-        double val = ii.val() * x(index[1]);
-        if (!handle_nan || !(std::isnan(val) || std::isinf(val))) {
-            y.add(  {{index[0]}},  val);
-        }
+    std::array<int,2> const &adims(transpose ? COL_MAJOR : ROW_MAJOR);
+    long const nj = M.shape[adims[1]];
+    if (x.lbound(0) > 0 || x.ubound(0) < nj-1) {
+        (*spsparse_error)(-1, "x (%d..%d) must cover inner dimension of M (0..%ld)",
+            x.lbound(0), x.ubound(0), nj-1);
+    }
+
+    if (M.size() == 0) return;
+
+    if (needs_resorted_copy(M, adims)) {
+        multiply(y, resorted_copy(M), x, handle_nan, transpose);
+        return;
+    }
+    Consolidate<MatT> Mcon(&M, adims);
+    MatT const &A(Mcon());
+    if (A.size() == 0) return;
+
+    // Gather from x directly if we can
+    PooledVector<double> xcopy;
+    double const *xp;
+    if (x.stride(0) == 1) {
+        xp = x.dataZero();
+    } else {
+        xcopy.resize(nj);
+        for (long j=0; j<nj; ++j) xcopy[j] = x(j);
+        xp = xcopy.data();
+    }
+
+    typename MatT::index_type const *cols = &A.index(adims[1], 0);
+    typename MatT::val_type const *vals = &A.val(0);
+    auto const &db(A.dim_beginnings());
+    size_t r = 0;
+    for (auto ai(A.dim_beginnings_xiter()); !ai.eof(); ++ai, ++r) {
+        y.add({*ai}, sparse_dot(cols + db[r], vals + db[r], db[r+1] - db[r], xp, handle_nan));
     }
 }
 
-template<class VectorCooMatrixT, class AccumulatorT>
+/** @brief (Transpose of Sparse Matrix) * (Dense Vector)
+
+@see spsparse::multiply(AccumulatorT &, MatT const &, blitz::Array<double,1> const &, bool, bool) */
+template<class MatT, class AccumulatorT>
 void multiplyT(
-    VectorCooMatrixT const &M,
-    blitz::Array<double,1> const &x,
     AccumulatorT &y,
+    MatT const &M,
+    blitz::Array<double,1> const &x,
     bool handle_nan = false)
-{ return multiply(M, x, y, handle_nan, true); }
-#endif
+{ return multiply(y, M, x, handle_nan, true); }
+
 
 // ---------------------------------------------------
+/** @brief Batched (Sparse Matrix) * (Dense Vectors)
+
+Computes, for each field f:
+@code
+Y(f,:) += C * diag(scalei) * A * diag(scalej) * X(f,:)
+@endcode
+A is traversed only once for all fields; each of its elements is
+loaded once, and the inner loop runs over fields.
+
+@param Y Output (nfield x A.shape[0]); results are added to it.
+@param X Right-hand sides (nfield x A.shape[1]).
+
+@see spsparse::multiply_batch() for sparse right-hand sides.
+*/
+template<class ScaleIT, class MatAT, class ScaleJT>
+void multiply_batch(
+    blitz::Array<double,2> &Y,
+    double C,       // Multiply everything by this
+    ScaleIT const *scalei,
+    MatAT const &A,
+    char transpose_A,           // 'T' for transpose, '.' otherwise
+    ScaleJT const *scalej,      // Vector
+    blitz::Array<double,2> const &X,
+    DuplicatePolicy duplicate_policy = DuplicatePolicy::ADD,
+    bool zero_nan = false);
+
+template<class ScaleIT, class MatAT, class ScaleJT>
+void multiply_batch(
+    blitz::Array<double,2> &Y,
+    double C,       // Multiply everything by this
+    ScaleIT const *scalei,
+    MatAT const &A,
+    char transpose_A,           // 'T' for transpose, '.' otherwise
+    ScaleJT const *scalej,      // Vector
+    blitz::Array<double,2> const &X,
+    DuplicatePolicy duplicate_policy,
+    bool zero_nan)
+{
+    std::array<int,2> const &a_sort_order(transpose_A == 'T' ? COL_MAJOR : ROW_MAJOR);
+    size_t const nfield = X.extent(0);
+    size_t const nj = A.shape[a_sort_order[1]];
+
+    if (Y.extent(0) != X.extent(0) || Y.extent(1) != A.shape[a_sort_order[0]]) {
+        (*spsparse_error)(-1, "Y (%d x %d) must have shape (%d x %ld)",
+            Y.extent(0), Y.extent(1), X.extent(0), A.shape[a_sort_order[0]]);
+    }
+    if (X.extent(1) != nj) {
+        (*spsparse_error)(-1, "Inner dimensions for A (%ld) and X (%d) must match!", nj, X.extent(1));
+    }
+
+    // Short-circuit return on empty output
+    if ((isnone(C))
+        || (scalei && scalei->size() == 0)
+        || (A.size() == 0)
+        || (scalej && scalej->size() == 0)
+        || (nfield == 0))
+    { return; }
+
+    // --------- Consolidate the matrices if needed
+    if (needs_resorted_copy(A, a_sort_order)) {
+        multiply_batch(Y, C, scalei, resorted_copy(A), transpose_A,
+            scalej, X, duplicate_policy, zero_nan);
+        return;
+    }
+    Consolidate<MatAT> Acon(&A, a_sort_order, duplicate_policy, zero_nan);
+
+    // Transpose right-hand sides to points x fields
+    int const xf0 = X.lbound(0);
+    int const xj0 = X.lbound(1);
+    PooledVector<double> Xt(nj * nfield);
+    for (size_t j=0; j<nj; ++j)
+    for (size_t f=0; f<nfield; ++f)
+        Xt[j*nfield + f] = X(xf0+f, xj0+j);
+
+    int const yf0 = Y.lbound(0);
+    int const yi0 = Y.lbound(1);
+    multiply_batch_rows(
+        DenseScale<typename ScaleIT::val_type>(scalei, A.shape[a_sort_order[0]]),
+        Acon(),
+        DenseScale<typename ScaleJT::val_type>(scalej, nj),
+        Xt.data(), nfield,
+        [&](typename MatAT::index_type aix, double a_scale, double const *acc) {
+            for (size_t f=0; f<nfield; ++f)
+                Y(yf0+f, yi0+aix) += acc[f] * C * a_scale;
+        });
+}
 
 /** @} */
+
+}   // Namespace
+#endif  // Guard
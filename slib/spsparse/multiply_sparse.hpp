@@ -19,8 +19,12 @@
 #ifndef SPSPARSE_MULTIPLY_SPARSE_HPP
 #define SPSPARSE_MULTIPLY_SPARSE_HPP
 
+#include <algorithm>
+#include <vector>
 #include <spsparse/xiter.hpp>
 #include <spsparse/array.hpp>
+#include <spsparse/parallel.hpp>
+#include <spsparse/arena.hpp>
 
 namespace spsparse {
 
@@ -54,26 +58,15 @@ multiply(retV, 1.0, NULL, AB,'.', NULL, V);
 
 /** @brief Internal helper class for sparse-sparse multiplication.
 
-Superclass used to chose whether we do/do not multiply our
-matrix by a diagonal scaling matrix */
-template<class MatT>
-struct MultXiter {
-    virtual typename MatT::index_type index() = 0;
-    virtual bool eof() = 0;
-    virtual void operator++() = 0;
-    virtual typename MatT::val_type scale_val() = 0;
-    virtual typename DimBeginningsXiter<MatT>::sub_xiter_type sub_xiter() = 0;
-};
+Iterates over the rows of a matrix, reporting a scale of 1 for each.
+Use this if you do NOT want to use a diagonal scaling matrix.
 
-
-/** @brief Internal helper class for sparse-sparse multiplication.
-
-Use this if you do NOT want to use a diagonal scaling matrix. */
+@see spsparse::ScaledMultXiter */
 template<class MatT>
-class SimpleMultXiter : public MultXiter<MatT>
+class SimpleMultXiter
 {
     // SPSPARSE_LOCAL_TYPES(MatT);
-    DimBeginningsXiter<MatT> ii;
+    typename MatT::dim_beginnings_xiter_type ii;
 public:
     SimpleMultXiter(MatT const &A)
         : ii(A.dim_beginnings_xiter())
@@ -83,19 +76,21 @@ public:
     bool eof() { return ii.eof(); }
     void operator++() { ++ii; }
     typename MatT::val_type scale_val() { return 1; }
-    typename DimBeginningsXiter<MatT>::sub_xiter_type sub_xiter() { return ii.sub_xiter(); }
+    typename MatT::dim_beginnings_xiter_type::sub_xiter_type sub_xiter() { return ii.sub_xiter(); }
 };
 // ---------------------------------------------------------
 /** @brief Internal helper class for sparse-sparse multiplication.
 
+Iterates over the rows of a matrix that are also in a diagonal
+scaling matrix.  Same interface as spsparse::SimpleMultXiter.
 Use this if you DO want to use a diagonal scaling matrix. */
 template<class MatT, class ScaleT>
-class ScaledMultXiter : public MultXiter<MatT>
+class ScaledMultXiter
 {
     // SPSPARSE_LOCAL_TYPES(MatT);
 
     Join2Xiter<
-        DimBeginningsXiter<MatT>,
+        typename MatT::dim_beginnings_xiter_type,
         ValSTLXiter<typename ScaleT::const_dim_iterator>> ii;
 public:
     ScaledMultXiter(MatT const &A, ScaleT const &scale)
@@ -106,32 +101,215 @@ public:
     typename MatT::index_type index() { return *ii.i1; }
     bool eof() { return ii.eof(); }
     void operator++() { ++ii; }
-    typename MatT::val_type scale_val() { return ii.i2.val(); }
-    typename DimBeginningsXiter<MatT>::sub_xiter_type sub_xiter() { return ii.i1.sub_xiter(); }
+    typename ScaleT::val_type scale_val() { return ii.i2.val(); }
+    typename MatT::dim_beginnings_xiter_type::sub_xiter_type sub_xiter() { return ii.i1.sub_xiter(); }
 };
 
-// ---------------------------------------------------------
+// -------------------------------------------------------------
+/** @brief Internal helper class for sparse-sparse multiplication.
+
+A diagonal scaling matrix, expanded to a dense vector so it can be
+looked up in O(1).  If no scaling matrix is given, every element is
+present, with value 1. */
+template<class ValT>
+class DenseScale
+{
+    PooledVector<ValT> vals;
+    PooledVector<char> present;
+public:
+    template<class ScaleT>
+    DenseScale(ScaleT const *scale, size_t n)
+    {
+        if (!scale) return;
+        vals.resize(n, 0);
+        present.resize(n, 0);
+        for (auto ii=scale->begin(); ii != scale->end(); ++ii) {
+            vals[ii.index(0)] = ii.val();
+            present[ii.index(0)] = 1;
+        }
+    }
+
+    bool has(size_t i) const
+        { return present.size() == 0 || present[i]; }
+    ValT operator[](size_t i) const
+        { return vals.size() == 0 ? 1 : vals[i]; }
+};
+
+/** @brief Internal helper class for sparse-sparse multiplication.
+
+Dense sparse accumulator (SPA) for one row of output.  Uses O(ncols)
+memory, but resetting between rows costs only O(columns touched). */
+template<class IndexT, class ValT>
+class DenseSpa
+{
+    PooledVector<ValT> vals;
+    PooledVector<size_t> stamp;     // Row in which each column was last touched, +1
+    size_t row;
+public:
+    PooledVector<IndexT> touched;   // Columns touched in the current row
+
+    DenseSpa(size_t ncols) : vals(ncols), stamp(ncols, 0), row(0) {}
+
+    /** @param max_nnz Upper bound on columns touched in the row (unused) */
+    void start_row(size_t /*max_nnz*/)
+    {
+        ++row;
+        touched.clear();
+    }
+
+    void add(IndexT k, ValT v)
+    {
+        if (stamp[k] != row) {
+            stamp[k] = row;
+            vals[k] = 0;
+            touched.push_back(k);
+        }
+        vals[k] += v;
+    }
+
+    ValT operator[](IndexT k) const { return vals[k]; }
+};
+
+/** @brief Internal helper class for sparse-sparse multiplication.
+
+Hashed sparse accumulator (SPA) for one row of output.  Used instead
+of spsparse::DenseSpa when the output has so many columns that a dense
+row would be mostly empty.  Open addressing with linear probing (as in
+spsparse::HashAccum); the table is reused from row to row, and only the
+slots filled in the previous row are reset. */
+template<class IndexT, class ValT>
+class HashSpa
+{
+    static const IndexT EMPTY = (IndexT)-1;
+
+    size_t ncols;
+    int slot_bits;
+    PooledVector<IndexT> keys;      // Column held in each slot (or EMPTY)
+    PooledVector<ValT> vals;        // Size is a power of 2
+    PooledVector<size_t> used;      // Slots filled in the current row
+
+    size_t slot_of(IndexT k) const
+        { return (size_t)(((uint64_t)k * 0x9E3779B97F4A7C15ull) >> (64 - slot_bits)); }
+public:
+    PooledVector<IndexT> touched;   // Columns touched in the current row
+
+    HashSpa(size_t _ncols) : ncols(_ncols), slot_bits(0) {}
+
+    /** @param max_nnz Upper bound on columns touched in the row.  The
+    table grows (but never shrinks) to keep the load factor at or
+    below 1/2. */
+    void start_row(size_t max_nnz)
+    {
+        for (size_t s : used) keys[s] = EMPTY;
+        used.clear();
+        touched.clear();
+
+        max_nnz = std::min(max_nnz, ncols);
+        int bits = std::max(slot_bits, 4);
+        while (((size_t)1 << bits) < 2 * max_nnz) ++bits;
+        if (bits != slot_bits) {
+            slot_bits = bits;
+            keys.assign((size_t)1 << slot_bits, EMPTY);
+            vals.resize((size_t)1 << slot_bits);
+        }
+    }
+
+    void add(IndexT k, ValT v)
+    {
+        size_t const mask = keys.size() - 1;
+        size_t s = slot_of(k);
+        for (; keys[s] != k; s = (s + 1) & mask) {
+            if (keys[s] == EMPTY) {
+                keys[s] = k;
+                vals[s] = 0;
+                used.push_back(s);
+                touched.push_back(k);
+                break;
+            }
+        }
+        vals[s] += v;
+    }
+
+    ValT operator[](IndexT k) const
+    {
+        size_t const mask = keys.size() - 1;
+        size_t s = slot_of(k);
+        while (keys[s] != k) s = (s + 1) & mask;
+        return vals[s];
+    }
+};
+
+template<class IndexT, class ValT>
+const IndexT HashSpa<IndexT, ValT>::EMPTY;
+
 /** @brief Internal helper function for sparse-sparse multiplication.
 
-Chooses the correct spsparse::MultXiter, based on whether or not there
-is a diagonal scaling matrix.
-*/
-template<class MatT, class ScaleT>
-std::unique_ptr<MultXiter<MatT>> new_mult_xiter(MatT const &A, ScaleT const *scale);
+Gustavson's row-by-row algorithm.  Each row i of the output is
+accumulated in spa as the sum over j of A(i,j) * scalej(j) * B(j,:).
+Contributions to each output element are summed in order of j, just
+as when joining row i of A with each column of B.
 
-template<class MatT, class ScaleT>
-std::unique_ptr<MultXiter<MatT>> new_mult_xiter(MatT const &A, ScaleT const *scale)
+@param A Consolidated with rows along dimension 0 of the product.
+@param B Consolidated with rows along the inner dimension.
+@param bdims Dimensions of B: {inner, output column}. */
+template<class SpaT, class ScaleIT, class MatAT, class ScaleJT, class MatBT, class ScaleKT, class AccumulatorT>
+void multiply_gustavson(
+    AccumulatorT &ret,
+    SpaT &spa,
+    double C,
+    DenseScale<ScaleIT> const &scalei,
+    MatAT const &A,
+    DenseScale<ScaleJT> const &scalej,
+    MatBT const &B,
+    std::array<int,2> const &bdims,
+    DenseScale<ScaleKT> const &scalek)
 {
-    if (scale) {
-        return std::unique_ptr<MultXiter<MatT>>(
-            new ScaledMultXiter<MatT, ScaleT>(A, *scale));
-    } else {
-        return std::unique_ptr<MultXiter<MatT>>(
-            new SimpleMultXiter<MatT>(A));
+    // Locate each row of B
+    size_t const nj = B.shape[bdims[0]];
+    std::vector<size_t> brow_begin(nj, 0);
+    std::vector<size_t> brow_end(nj, 0);
+    auto const &bdb(B.dim_beginnings());
+    for (size_t r=0; r+1 < bdb.size(); ++r) {
+        auto const j = B.index(bdims[0], bdb[r]);
+        brow_begin[j] = bdb[r];
+        brow_end[j] = bdb[r+1];
     }
 
+    // ------ Loop 1: Rows in A
+    for (auto ai(A.dim_beginnings_xiter()); !ai.eof(); ++ai) {
+        auto aix(*ai);
+        if (!scalei.has(aix)) continue;
+        auto a_scale(scalei[aix]);
+        if (isnone(a_scale)) continue;
+
+        // ------ Loop 2: Scatter A(i,j) * B(j,:) into the SPA
+        size_t max_nnz = 0;
+        for (auto aj(ai.sub_xiter()); !aj.eof(); ++aj)
+            max_nnz += brow_end[*aj] - brow_begin[*aj];
+        spa.start_row(max_nnz);
+        for (auto aj(ai.sub_xiter()); !aj.eof(); ++aj) {
+            auto const j = *aj;
+            if (!scalej.has(j)) continue;
+            auto const a_sj = aj.val() * scalej[j];
+            for (size_t bk=brow_begin[j]; bk < brow_end[j]; ++bk)
+                spa.add(B.index(bdims[1], bk), a_sj * B.val(bk));
+        }
+
+        // ------ Loop 3: Gather the row, in column order
+        std::sort(spa.touched.begin(), spa.touched.end());
+        for (auto ii=spa.touched.begin(); ii != spa.touched.end(); ++ii) {
+            auto bix(*ii);
+            if (!scalek.has(bix)) continue;
+            auto b_scale(scalek[bix]);
+            if (isnone(b_scale)) continue;
+
+            typename AccumulatorT::val_type sum = spa[bix];
+            if (!isnone(sum)) {
+                ret.add({aix, bix}, sum * C * a_scale * b_scale);
+            }
+        }
+    }
 }
-// -------------------------------------------------------------
 /** @brief Matrix-matrix multiply.
 
 Computes:
@@ -139,6 +317,11 @@ Computes:
 ret = C * diag(scalei) * A * diag(scalej) * B * diag(scalek)
 @endcode
 
+Uses Gustavson's row-by-row algorithm, so the cost is proportional to
+the number of multiplications actually performed, not to
+(rows of A) * (columns of B).  Output is added to ret in row-major
+order.
+
 @param ret Accumulator for output.
 @param C Constant to multiply by.
 @param scalei Vector for diagonal scale matrix (NULL if not used).
@@ -187,7 +370,6 @@ void multiply(
 
     // Set dimensions of output, even if we store nothing in it.
     std::array<int,2> const &a_sort_order(transpose_A == 'T' ? COL_MAJOR : ROW_MAJOR);
-    std::array<int,2> const &b_sort_order(transpose_B == 'T' ? ROW_MAJOR : COL_MAJOR);
     ret.set_shape({A.shape[adims[0]], B.shape[bdims[1]]});
 
     // Check inner dimensions
@@ -217,66 +399,161 @@ void multiply(
         || (scalek && scalek->size() == 0))
     { return; }
 
+    // --------- Fixed-order arrays (eg: a CscArray used by rows) are
+    // re-sorted through a copy
+    if (needs_resorted_copy(A, a_sort_order)) {
+        multiply(ret, C, scalei, resorted_copy(A), transpose_A,
+            scalej, B, transpose_B, scalek, duplicate_policy, zero_nan);
+        return;
+    }
+    if (needs_resorted_copy(B, bdims)) {
+        multiply(ret, C, scalei, A, transpose_A,
+            scalej, resorted_copy(B), transpose_B, scalek, duplicate_policy, zero_nan);
+        return;
+    }
+
     // --------- Consolidate the matrices if needed
+    // (B is traversed by rows along the inner dimension)
     Consolidate<MatAT> Acon(&A, a_sort_order, duplicate_policy, zero_nan);
-    Consolidate<MatBT> Bcon(&B, b_sort_order, duplicate_policy, zero_nan);
+    Consolidate<MatBT> Bcon(&B, bdims, duplicate_policy, zero_nan);
+
+    DenseScale<typename ScaleIT::val_type> scalei_d(scalei, A.shape[adims[0]]);
+    DenseScale<typename ScaleJT::val_type> scalej_d(scalej, A.shape[adims[1]]);
+    DenseScale<typename ScaleKT::val_type> scalek_d(scalek, B.shape[bdims[1]]);
+
+    // Use a dense SPA unless the output is much wider than B has elements
+    typedef typename MatBT::index_type IndexT;
+    typedef typename AccumulatorT::val_type ValT;
+    size_t const ncols = B.shape[bdims[1]];
+    if (ncols <= 16 * Bcon().size() + 1024) {
+        DenseSpa<IndexT, ValT> spa(ncols);
+        multiply_gustavson(ret, spa, C,
+            scalei_d, Acon(), scalej_d, Bcon(), bdims, scalek_d);
+    } else {
+        HashSpa<IndexT, ValT> spa(ncols);
+        multiply_gustavson(ret, spa, C,
+            scalei_d, Acon(), scalej_d, Bcon(), bdims, scalek_d);
+    }
+}
+// ------------------------------------------------------------
+/** @brief Internal helper function for sparse-sparse multiplication.
+
+Multi-threaded matrix-vector multiply.  The rows of A are split
+among threads so each thread gets about the same number of elements.
+Each row's result goes in its own slot, so no locking is needed.
+Results are then added to ret in row order, exactly as the
+single-threaded multiply() would.
 
+@param A Consolidated with rows along dimension 0 of the product.
+@param V Consolidated. */
+template<class ScaleIT, class MatAT, class ScaleJT, class VecT, class AccumulatorT>
+void multiply_threaded(
+    AccumulatorT &ret,
+    double C,
+    DenseScale<ScaleIT> const &scalei,
+    MatAT const &A,
+    std::array<int,2> const &adims,
+    DenseScale<ScaleJT> const &scalej,
+    DenseScale<VecT> const &V,
+    int nthreads)
+{
+    typedef typename AccumulatorT::val_type ValT;
+
+    auto const &db(A.dim_beginnings());
+    size_t const nrows = db.size() - 1;
+    PooledVector<typename MatAT::index_type> aixs(nrows);
+    PooledVector<ValT> sums(nrows);
+
+    run_threads(nthreads, [&](int tid) {
+        // Split rows to balance the number of elements per thread
+        auto row_begin = [&](int t) -> size_t {
+            return std::lower_bound(db.begin(), db.begin() + nrows,
+                slice_begin(db[nrows], nthreads, t)) - db.begin();
+        };
+        size_t const r0 = row_begin(tid);
+        size_t const r1 = row_begin(tid+1);
+
+        for (size_t r=r0; r<r1; ++r) {
+            aixs[r] = A.index(adims[0], db[r]);
+            ValT sum = 0;
+            for (size_t ix=db[r]; ix < db[r+1]; ++ix) {
+                auto const j = A.index(adims[1], ix);
+                if (!scalej.has(j) || !V.has(j)) continue;
+                sum += A.val(ix) * scalej[j] * V[j];
+            }
+            sums[r] = sum;
+        }
+    });
+
+    for (size_t r=0; r<nrows; ++r) {
+        auto aix(aixs[r]);
+        if (!scalei.has(aix)) continue;
+        auto a_scale(scalei[aix]);
+        if (isnone(a_scale)) continue;
+        if (!isnone(sums[r])) ret.add({aix}, sums[r] * C * a_scale);
+    }
+}
+// ------------------------------------------------------------
+/** @brief Internal helper function for sparse-sparse multiplication.
+
+Loop over the rows of A for matrix-vector multiply.  It is templated on
+the row iterator (spsparse::SimpleMultXiter or
+spsparse::ScaledMultXiter), so the unscaled and scaled paths are each
+compiled and inlined on their own, with no virtual calls or heap
+allocations. */
+template<class MultXiterT, class ScaleJT, class VecT, class AccumulatorT>
+void multiply_rows(
+    AccumulatorT &ret,
+    double C,
+    MultXiterT &&join_a,
+    ScaleJT const *scalej,
+    VecT const &V)
+{
     // Multiply each row by each column
     // ------ Loop 1: Rows in A 
-    for (auto join_a(new_mult_xiter(Acon(), scalei));
-        !join_a->eof(); ++(*join_a))
+    for (; !join_a.eof(); ++join_a)
     {
-        if (isnone(join_a->scale_val())) continue;
-        auto aix(join_a->index());
-        auto a_scale(join_a->scale_val());
+        if (isnone(join_a.scale_val())) continue;
+        auto aix(join_a.index());
+        auto a_scale(join_a.scale_val());
 
 #if 0
 printf("Starting row %d:", aix);
-for (auto ii=join_a->sub_xiter(); !ii.eof(); ++ii) {
+for (auto ii=join_a.sub_xiter(); !ii.eof(); ++ii) {
     printf(" (%d : %g)", *ii, ii.val());
     }
 printf("\n");
 #endif
+        // ---------- Loop 3: Multiply A row by the single B column
+        typename AccumulatorT::val_type sum = 0;
 
-        // ------ Loop 2: Cols in B
-        for (auto join_b(new_mult_xiter(Bcon(), scalek));
-            !join_b->eof(); ++(*join_b))
-        {
-            if (isnone(join_b->scale_val())) continue;
-            auto bix(join_b->index());
-            auto b_scale(join_b->scale_val());
-#if 0
-printf("  Starting col %d\n", bix);
-#endif
-
-            // ---------- Loop 3: Multiply A row by B column
-            typename AccumulatorT::val_type sum = 0;
-
-            if (scalej) {
-                // ----- With scalej
-                for (auto ab(join3_xiter(
-                    join_a->sub_xiter(),
-                    make_val_xiter(scalej->dim_begin(0), scalej->dim_end(0)),
-                    join_b->sub_xiter()));
-                    !ab.eof(); ++ab)
-                { sum += ab.i1.val() * ab.i2.val() * ab.i3.val(); }
-            } else {
-                // ----- Without scalej
-                for (auto ab(join2_xiter(
-                    join_a->sub_xiter(),
-                    join_b->sub_xiter()));
-                    !ab.eof(); ++ab)
-                { sum += ab.i1.val() * ab.i2.val(); }
+        if (scalej) {
+            // ----- With scalej
+            for (auto ab(join3_xiter(
+                join_a.sub_xiter(),
+                make_val_xiter(scalej->dim_begin(0), scalej->dim_end(0)),
+                make_val_xiter(V.dim_begin(0), V.dim_end(0))));
+                !ab.eof(); ++ab)
+            { sum += ab.i1.val() * ab.i2.val() * ab.i3.val(); }
+        } else {
+            // ----- Without scalej
+            for (auto ab(join2_xiter(
+                join_a.sub_xiter(),
+                make_val_xiter(V.dim_begin(0), V.dim_end(0))));
+                !ab.eof(); ++ab)
+            {
+//printf("    triplet %d=?%d: %g*%g = %g\n", *ab.i1, *ab.i2, ab.i1.val(), ab.i2.val(), ab.i1.val()*ab.i2.val());
+                sum += ab.i1.val() * ab.i2.val();
             }
+        }
 
-            if (!isnone(sum)) {
+        if (!isnone(sum)) {
 #if 0
-printf("set: (%d %d : %g)\n", aix, bix, sum * C * a_scale * b_scale);
+printf("    set: (%d : %g)\n", aix, sum * C * a_scale);
 #endif
-                ret.add({aix, bix}, sum * C * a_scale * b_scale);
-            }
-
+            ret.add({aix}, sum * C * a_scale);
         }
+
     }
 
 }
@@ -297,6 +574,8 @@ ret = C * diag(scalei) * A * diag(scalej) * V
 @param V Vector
 @param duplicate_policy Use if A or B needs to be consolidated.
 @param zero_nan Use if A or B needs to be consolidated.
+@param nthreads Number of threads to use.  If >1, rows of A are
+       computed in parallel; the result is the same.
 
 @see spsparse::consolidate()
 */
@@ -310,7 +589,8 @@ void multiply(
     ScaleJT const *scalej,      // Vector
     VecT const &V,
     DuplicatePolicy duplicate_policy = DuplicatePolicy::ADD,
-    bool zero_nan = false);
+    bool zero_nan = false,
+    int nthreads = 1);
 
 template<class ScaleIT, class MatAT, class ScaleJT, class VecT, class AccumulatorT>
 void multiply(
@@ -322,7 +602,8 @@ void multiply(
     ScaleJT const *scalej,      // Vector
     VecT const &V,
     DuplicatePolicy duplicate_policy = DuplicatePolicy::ADD,
-    bool zero_nan = false)
+    bool zero_nan = false,
+    int nthreads = 1)
 {
     // Set dimensions of output, even if we store nothing in it.
     std::array<int,2> const &a_sort_order(transpose_A == 'T' ? COL_MAJOR : ROW_MAJOR);
@@ -343,59 +624,164 @@ void multiply(
     { return; }
 
     // --------- Consolidate the matrices if needed
+    if (needs_resorted_copy(A, a_sort_order)) {
+        multiply(ret, C, scalei, resorted_copy(A), transpose_A,
+            scalej, V, duplicate_policy, zero_nan, nthreads);
+        return;
+    }
     Consolidate<MatAT> Acon(&A, a_sort_order, duplicate_policy, zero_nan);
     Consolidate<VecT> Vcon(&V, {0}, duplicate_policy, zero_nan);
 
 //std::cout << "Vcon: " << Vcon() << std::endl;
 
-    // Multiply each row by each column
-    // ------ Loop 1: Rows in A 
-    for (auto join_a(new_mult_xiter(Acon(), scalei));
-        !join_a->eof(); ++(*join_a))
-    {
-        if (isnone(join_a->scale_val())) continue;
-        auto aix(join_a->index());
-        auto a_scale(join_a->scale_val());
+    if (nthreads > 1) {
+        multiply_threaded(ret, C,
+            DenseScale<typename ScaleIT::val_type>(scalei, A.shape[a_sort_order[0]]),
+            Acon(), a_sort_order,
+            DenseScale<typename ScaleJT::val_type>(scalej, A.shape[a_sort_order[1]]),
+            DenseScale<typename VecT::val_type>(&Vcon(), V.shape[0]),
+            nthreads);
+        return;
+    }
 
-#if 0
-printf("Starting row %d:", aix);
-for (auto ii=join_a->sub_xiter(); !ii.eof(); ++ii) {
-    printf(" (%d : %g)", *ii, ii.val());
+    if (scalei) {
+        multiply_rows(ret, C, ScaledMultXiter<MatAT, ScaleIT>(Acon(), *scalei), scalej, Vcon());
+    } else {
+        multiply_rows(ret, C, SimpleMultXiter<MatAT>(Acon()), scalej, Vcon());
     }
-printf("\n");
-#endif
-        // ---------- Loop 3: Multiply A row by the single B column
-        typename AccumulatorT::val_type sum = 0;
+}
 
-        if (scalej) {
-            // ----- With scalej
-            for (auto ab(join3_xiter(
-                join_a->sub_xiter(),
-                make_val_xiter(scalej->dim_begin(0), scalej->dim_end(0)),
-                make_val_xiter(Vcon().dim_begin(0), Vcon().dim_end(0))));
-                !ab.eof(); ++ab)
-            { sum += ab.i1.val() * ab.i2.val() * ab.i3.val(); }
-        } else {
-            // ----- Without scalej
-            for (auto ab(join2_xiter(
-                join_a->sub_xiter(),
-                make_val_xiter(Vcon().dim_begin(0), Vcon().dim_end(0))));
-                !ab.eof(); ++ab)
-            {
-//printf("    triplet %d=?%d: %g*%g = %g\n", *ab.i1, *ab.i2, ab.i1.val(), ab.i2.val(), ab.i1.val()*ab.i2.val());
-                sum += ab.i1.val() * ab.i2.val();
-            }
+// ------------------------------------------------------------
+/** @brief Internal helper function for batched multiplication.
+
+Streams through the rows of A once.  For each row i, computes
+@code
+acc[f] = sum_j A(i,j) * scalej(j) * Xt[j*nfield + f]
+@endcode
+for all fields f at once, then calls emit(aix, a_scale, acc).  Each
+element of A is loaded once, and the inner loop over fields is
+contiguous.
+
+@param A Consolidated with rows along dimension 0 of the product.
+@param Xt Right-hand sides, stored points x fields. */
+template<class ValT, class ScaleIT, class MatAT, class ScaleJT, class EmitT>
+void multiply_batch_rows(
+    DenseScale<ScaleIT> const &scalei,
+    MatAT const &A,
+    DenseScale<ScaleJT> const &scalej,
+    ValT const *Xt,
+    size_t nfield,
+    EmitT const &emit)
+{
+    std::vector<ValT> acc(nfield);
+    for (auto ai(A.dim_beginnings_xiter()); !ai.eof(); ++ai) {
+        auto aix(*ai);
+        if (!scalei.has(aix)) continue;
+        auto a_scale(scalei[aix]);
+        if (isnone(a_scale)) continue;
+
+        ValT * const accp = acc.data();
+        std::fill(acc.begin(), acc.end(), 0);
+        for (auto aj(ai.sub_xiter()); !aj.eof(); ++aj) {
+            auto const j = *aj;
+            if (!scalej.has(j)) continue;
+            ValT const w = aj.val() * scalej[j];
+            ValT const * const x = Xt + j*nfield;
+            for (size_t f=0; f<nfield; ++f) accp[f] += w * x[f];
         }
+        emit(aix, a_scale, (ValT const *)accp);
+    }
+}
 
-        if (!isnone(sum)) {
-#if 0
-printf("    set: (%d : %g)\n", aix, sum * C * a_scale);
-#endif
-            ret.add({aix}, sum * C * a_scale);
+/** @brief Batched matrix-vector multiply.
+
+Computes, for each f:
+@code
+*rets[f] = C * diag(scalei) * A * diag(scalej) * (*Vs[f])
+@endcode
+Same result as calling the matrix-vector multiply() once per
+right-hand side, but A is traversed only once.
+
+@param rets Accumulators for output, one per right-hand side.
+@param Vs Right-hand side vectors; must be the same length as rets.
+
+@see spsparse::multiply()
+*/
+template<class ScaleIT, class MatAT, class ScaleJT, class VecT, class AccumulatorT>
+void multiply_batch(
+    std::vector<AccumulatorT *> const &rets,
+    double C,       // Multiply everything by this
+    ScaleIT const *scalei,
+    MatAT const &A,
+    char transpose_A,           // 'T' for transpose, '.' otherwise
+    ScaleJT const *scalej,      // Vector
+    std::vector<VecT const *> const &Vs,
+    DuplicatePolicy duplicate_policy = DuplicatePolicy::ADD,
+    bool zero_nan = false);
+
+template<class ScaleIT, class MatAT, class ScaleJT, class VecT, class AccumulatorT>
+void multiply_batch(
+    std::vector<AccumulatorT *> const &rets,
+    double C,       // Multiply everything by this
+    ScaleIT const *scalei,
+    MatAT const &A,
+    char transpose_A,           // 'T' for transpose, '.' otherwise
+    ScaleJT const *scalej,      // Vector
+    std::vector<VecT const *> const &Vs,
+    DuplicatePolicy duplicate_policy,
+    bool zero_nan)
+{
+    typedef typename AccumulatorT::val_type ValT;
+    std::array<int,2> const &a_sort_order(transpose_A == 'T' ? COL_MAJOR : ROW_MAJOR);
+    size_t const nfield = Vs.size();
+    size_t const nj = A.shape[a_sort_order[1]];
+
+    if (rets.size() != nfield) {
+        (*spsparse_error)(-1, "Number of outputs (%ld) and right-hand sides (%ld) must match!", rets.size(), nfield);
+    }
+
+    // Set dimensions of output, even if we store nothing in it.
+    for (size_t f=0; f<nfield; ++f) {
+        rets[f]->set_shape({A.shape[a_sort_order[0]]});
+        if (nj != Vs[f]->shape[0]) {
+            (*spsparse_error)(-1, "Inner dimensions for A (%ld) and V[%ld] (%ld) must match!", nj, f, Vs[f]->shape[0]);
         }
+    }
+
+    // Short-circuit return on empty output
+    if ((isnone(C))
+        || (scalei && scalei->size() == 0)
+        || (A.size() == 0)
+        || (scalej && scalej->size() == 0)
+        || (nfield == 0))
+    { return; }
+
+    // --------- Consolidate the matrices if needed
+    if (needs_resorted_copy(A, a_sort_order)) {
+        multiply_batch(rets, C, scalei, resorted_copy(A), transpose_A,
+            scalej, Vs, duplicate_policy, zero_nan);
+        return;
+    }
+    Consolidate<MatAT> Acon(&A, a_sort_order, duplicate_policy, zero_nan);
 
+    // Scatter right-hand sides, points x fields
+    PooledVector<ValT> Xt(nj * nfield, 0);
+    for (size_t f=0; f<nfield; ++f) {
+        Consolidate<VecT> Vcon(Vs[f], {0}, duplicate_policy, zero_nan);
+        for (auto ii=Vcon().begin(); ii != Vcon().end(); ++ii)
+            Xt[ii.index(0)*nfield + f] = ii.val();
     }
 
+    multiply_batch_rows(
+        DenseScale<typename ScaleIT::val_type>(scalei, A.shape[a_sort_order[0]]),
+        Acon(),
+        DenseScale<typename ScaleJT::val_type>(scalej, nj),
+        Xt.data(), nfield,
+        [&](typename MatAT::index_type aix, ValT a_scale, ValT const *acc) {
+            for (size_t f=0; f<nfield; ++f) {
+                if (!isnone(acc[f])) rets[f]->add({aix}, acc[f] * C * a_scale);
+            }
+        });
 }
 
 // ------------------------------------------------------------
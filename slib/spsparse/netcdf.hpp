@@ -19,9 +19,15 @@
 #ifndef SPSPARSE_NETCDF_HPP
 #define SPSPARSE_NETCDF_HPP
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
+#include <limits>
+#include <string>
+#include <type_traits>
 #include <ibmisc/netcdf.hpp>
 #include <spsparse/array.hpp>
+#include <spsparse/algorithm.hpp>
 
 namespace spsparse {
 
@@ -31,100 +37,462 @@ namespace spsparse {
 @{
 */
 
+/** @brief Default number of non-zeros moved per NetCDF call.
+
+nc_write_spsparse() and nc_read_spsparse() stage this many elements
+at a time in contiguous buffers, so memory use is bounded by about
+chunk_size * (rank * sizeof(index) + sizeof(val)). */
+const size_t NC_CHUNK_SIZE = 1024*1024;
+
+/** @brief True if AccumulatorT has a columnar
+add_bulk(std::array<index_type const *, rank>, val_type const *, size_t),
+as does VectorCooArray. */
+template<class AccumulatorT>
+class has_add_bulk
+{
+    template<class T>
+    static auto test(int) -> decltype(
+        std::declval<T &>().add_bulk(
+            std::declval<std::array<typename T::index_type const *, T::rank> const &>(),
+            std::declval<typename T::val_type const *>(),
+            (size_t)0),
+        std::true_type());
+    template<class T>
+    static std::false_type test(...);
+public:
+    static const bool value = decltype(test<AccumulatorT>(0))::value;
+};
+
+/** @brief Internal helper for nc_read_spsparse(): feeds one chunk of
+index columns to an accumulator, one element at a time. */
+template<class AccumulatorT>
+void _add_chunk(AccumulatorT *A,
+    std::array<std::vector<typename AccumulatorT::index_type>, AccumulatorT::rank> const &index_cols,
+    std::vector<typename AccumulatorT::val_type> const &vals,
+    size_t n,
+    std::false_type has_add_bulk)
+{
+    std::array<typename AccumulatorT::index_type, AccumulatorT::rank> index;
+    for (size_t i=0; i<n; ++i) {
+        for (int k=0; k<AccumulatorT::rank; ++k) index[k] = index_cols[k][i];
+        A->add(index, vals[i]);
+    }
+}
+
+/** @brief Internal helper for nc_read_spsparse(): feeds one chunk of
+index columns to an accumulator with a single add_bulk() call. */
+template<class AccumulatorT>
+void _add_chunk(AccumulatorT *A,
+    std::array<std::vector<typename AccumulatorT::index_type>, AccumulatorT::rank> const &index_cols,
+    std::vector<typename AccumulatorT::val_type> const &vals,
+    size_t n,
+    std::true_type has_add_bulk)
+{
+    std::array<typename AccumulatorT::index_type const *, AccumulatorT::rank> index_ptrs;
+    for (int k=0; k<AccumulatorT::rank; ++k) index_ptrs[k] = index_cols[k].data();
+    A->add_bulk(index_ptrs, vals.data(), n);
+}
+// --------------------------------------------------------
+
+/** @brief Writes the non-zeros of A to the variables vname.indices
+and vname.vals, which must already be defined (see ncio_spsparse()).
+
+Elements are gathered into contiguous buffers and written as
+hyperslabs of up to chunk_size elements each. */
 template<class ArrayT>
 void nc_write_spsparse(
     netCDF::NcGroup *nc,
     ArrayT *A,
-    std::string const &vname);
+    std::string const &vname,
+    size_t chunk_size = NC_CHUNK_SIZE);
 
 
 template<class ArrayT>
 void nc_write_spsparse(
     netCDF::NcGroup *nc,
     ArrayT *A,
-    std::string const &vname)
+    std::string const &vname,
+    size_t chunk_size)
 {
-    std::array<size_t, ArrayT::rank> shape;     // Extent of each dimension
+    const int RANK = ArrayT::rank;
 
     netCDF::NcVar indices_v = nc->getVar(vname + ".indices");
     netCDF::NcVar vals_v = nc->getVar(vname + ".vals");
 
+    size_t const size = A->size();
+    chunk_size = std::max((size_t)1, std::min(chunk_size, size));
+
+    // Row-major (size, rank) layout, as on disk
+    std::vector<typename ArrayT::index_type> index_buf(chunk_size * RANK);
+    std::vector<typename ArrayT::val_type> val_buf(chunk_size);
+
     std::vector<size_t> startp = {0, 0};        // SIZE, RANK
-    std::vector<size_t> countp = {1, A->rank};  // Write RANK elements at a time
-    for (auto ii = A->begin(); ii != A->end(); ++ii, ++startp[0]) {
-        typename ArrayT::indices_type index = ii.index();
-        typename ArrayT::val_type val = ii.val();
+    std::vector<size_t> countp = {0, (size_t)RANK};
+    auto ii = A->begin();
+    while (startp[0] < size) {
+        size_t const n = std::min(chunk_size, size - startp[0]);
+        for (size_t i=0; i<n; ++i, ++ii) {
+            for (int k=0; k<RANK; ++k) index_buf[i*RANK + k] = ii.index(k);
+            val_buf[i] = ii.val();
+        }
 
-        indices_v.putVar(startp, countp, &index[0]);
-        vals_v.putVar(startp, countp, &val);
+        countp[0] = n;
+        indices_v.putVar(startp, countp, &index_buf[0]);
+        vals_v.putVar({startp[0]}, {n}, &val_buf[0]);
+        startp[0] += n;
     }
 }
 // --------------------------------------------------------
 
+/** @brief Reads the non-zeros stored in vname.indices and vname.vals
+into an accumulator.
+
+Reads hyperslabs of up to chunk_size elements each.  Each chunk is
+handed to A->add_bulk() if the accumulator has it, or A->add()
+otherwise. */
 template<class AccumulatorT>
 void nc_read_spsparse(
     netCDF::NcGroup *nc,
     AccumulatorT *A,
-    std::string const &vname);
+    std::string const &vname,
+    size_t chunk_size = NC_CHUNK_SIZE);
 
 template<class AccumulatorT>
 void nc_read_spsparse(
     netCDF::NcGroup *nc,
     AccumulatorT *A,
-    std::string const &vname)
+    std::string const &vname,
+    size_t chunk_size)
 {
-    std::array<size_t, AccumulatorT::rank> shape;       // Extent of each dimension
+    const int RANK = AccumulatorT::rank;
+    typedef typename AccumulatorT::index_type IndexT;
 
     netCDF::NcVar indices_v = nc->getVar(vname + ".indices");
     netCDF::NcVar vals_v = nc->getVar(vname + ".vals");
 
     size_t size = vals_v.getDim(0).getSize();   // # non-zero elements
+    chunk_size = std::max((size_t)1, std::min(chunk_size, size));
+
+    std::vector<IndexT> index_buf(chunk_size * RANK);
+    std::array<std::vector<IndexT>, RANK> index_cols;
+    for (int k=0; k<RANK; ++k) index_cols[k].resize(chunk_size);
+    std::vector<typename AccumulatorT::val_type> val_buf(chunk_size);
 
     std::vector<size_t> startp = {0, 0};        // SIZE, RANK
-    std::vector<size_t> countp = {1, AccumulatorT::rank};   // Write RANK elements at a time
-    std::array<typename AccumulatorT::index_type, AccumulatorT::rank> index;
-    typename AccumulatorT::val_type val;
+    std::vector<size_t> countp = {0, (size_t)RANK};
+    while (startp[0] < size) {
+        size_t const n = std::min(chunk_size, size - startp[0]);
+        countp[0] = n;
+        indices_v.getVar(startp, countp, &index_buf[0]);
+        vals_v.getVar({startp[0]}, {n}, &val_buf[0]);
+
+        // Transpose (size, rank) --> one column per dimension
+        for (size_t i=0; i<n; ++i) {
+            for (int k=0; k<RANK; ++k) index_cols[k][i] = index_buf[i*RANK + k];
+        }
 
-    for (; startp[0]<size; ++startp[0]) {
-        indices_v.getVar(startp, countp, &index[0]);
-        vals_v.getVar(startp, countp, &val);
+        _add_chunk(A, index_cols, val_buf, n,
+            std::integral_constant<bool, has_add_bulk<AccumulatorT>::value>());
+        startp[0] += n;
+    }
+}
 
-        A->add(index, val);
+// -----------------------------------------------------------------
+/** @brief Smallest signed NetCDF integer type that can hold the
+indices 0..extent-1 of one dimension. */
+inline std::string nc_index_type(size_t extent)
+{
+    if (extent <= (size_t)std::numeric_limits<int8_t>::max()+1) return "byte";
+    if (extent <= (size_t)std::numeric_limits<int16_t>::max()+1) return "short";
+    if (extent <= (size_t)std::numeric_limits<int32_t>::max()+1) return "int";
+    return "int64";
+}
+
+/** @brief How ncio_spsparse() lays out a sparse array on disk.
+
+The default is the original layout: one 2-D int64 variable
+vname.indices(size, rank) plus vname.vals(size).  The columnar layout
+instead stores one 1-D variable vname.index<k>(size) per dimension,
+each of the narrowest integer type that fits shape[k], plus
+vname.vals(size).  Columnar variables are NetCDF-4 chunked, and may be
+compressed.  The reader detects the layout from the file. */
+struct NcSparseOptions {
+    /** Use the columnar layout */
+    bool columnar;
+
+    /** Length (in elements) of the NetCDF-4 storage chunks of the
+    columnar variables.  Clipped to the number of non-zeros. */
+    size_t storage_chunk;
+
+    /** zlib level (1-9) of the deflate filter; 0 for none.
+    Columnar layout only. */
+    int deflate_level;
+
+    /** Apply the shuffle filter (improves compression of integers).
+    Columnar layout only. */
+    bool shuffle;
+
+    /** Non-zeros staged in memory per read/write call
+    (see nc_write_spsparse()). */
+    size_t chunk_size;
+
+    /** If A is sorted, also store its dim_beginnings() (row pointers)
+    in vname.dim_beginnings, so the reader need not recompute them. */
+    bool dim_beginnings;
+
+    /** On read: verify the data really are sorted before trusting the
+    sort_order attribute (one pass over the indices).  If they are
+    not, the array is left unsorted. */
+    bool check_sorted;
+
+    /** Defaults give the original layout.  Set fields by name, eg:
+    @code
+    NcSparseOptions opts;
+    opts.columnar = true;
+    @endcode */
+    NcSparseOptions()
+    : columnar(false), storage_chunk(128*1024),
+        deflate_level(0), shuffle(false),
+        chunk_size(NC_CHUNK_SIZE), dim_beginnings(false),
+        check_sorted(true) {}
+};
+// -----------------------------------------------------------------
+/** @brief Columnar counterpart of nc_write_spsparse(): writes A to
+vname.index<k> and vname.vals, in hyperslabs of up to chunk_size
+elements. */
+template<class ArrayT>
+void nc_write_spsparse_columnar(
+    netCDF::NcGroup *nc,
+    ArrayT *A,
+    std::string const &vname,
+    size_t chunk_size = NC_CHUNK_SIZE);
+
+template<class ArrayT>
+void nc_write_spsparse_columnar(
+    netCDF::NcGroup *nc,
+    ArrayT *A,
+    std::string const &vname,
+    size_t chunk_size)
+{
+    const int RANK = ArrayT::rank;
+
+    std::array<netCDF::NcVar, RANK> index_v;
+    for (int k=0; k<RANK; ++k)
+        index_v[k] = nc->getVar(vname + ".index" + std::to_string(k));
+    netCDF::NcVar vals_v = nc->getVar(vname + ".vals");
+
+    size_t const size = A->size();
+    chunk_size = std::max((size_t)1, std::min(chunk_size, size));
+
+    std::array<std::vector<typename ArrayT::index_type>, RANK> index_cols;
+    for (int k=0; k<RANK; ++k) index_cols[k].resize(chunk_size);
+    std::vector<typename ArrayT::val_type> val_buf(chunk_size);
+
+    auto ii = A->begin();
+    for (size_t start=0; start < size; ) {
+        size_t const n = std::min(chunk_size, size - start);
+        for (size_t i=0; i<n; ++i, ++ii) {
+            for (int k=0; k<RANK; ++k) index_cols[k][i] = ii.index(k);
+            val_buf[i] = ii.val();
+        }
+
+        for (int k=0; k<RANK; ++k)
+            index_v[k].putVar({start}, {n}, &index_cols[k][0]);
+        vals_v.putVar({start}, {n}, &val_buf[0]);
+        start += n;
     }
 }
+// --------------------------------------------------------
+/** @brief Columnar counterpart of nc_read_spsparse(). */
+template<class AccumulatorT>
+void nc_read_spsparse_columnar(
+    netCDF::NcGroup *nc,
+    AccumulatorT *A,
+    std::string const &vname,
+    size_t chunk_size = NC_CHUNK_SIZE);
 
+template<class AccumulatorT>
+void nc_read_spsparse_columnar(
+    netCDF::NcGroup *nc,
+    AccumulatorT *A,
+    std::string const &vname,
+    size_t chunk_size)
+{
+    const int RANK = AccumulatorT::rank;
+
+    std::array<netCDF::NcVar, RANK> index_v;
+    for (int k=0; k<RANK; ++k)
+        index_v[k] = nc->getVar(vname + ".index" + std::to_string(k));
+    netCDF::NcVar vals_v = nc->getVar(vname + ".vals");
+
+    size_t size = vals_v.getDim(0).getSize();   // # non-zero elements
+    chunk_size = std::max((size_t)1, std::min(chunk_size, size));
+
+    std::array<std::vector<typename AccumulatorT::index_type>, RANK> index_cols;
+    for (int k=0; k<RANK; ++k) index_cols[k].resize(chunk_size);
+    std::vector<typename AccumulatorT::val_type> val_buf(chunk_size);
+
+    for (size_t start=0; start < size; ) {
+        size_t const n = std::min(chunk_size, size - start);
+        for (int k=0; k<RANK; ++k)
+            index_v[k].getVar({start}, {n}, &index_cols[k][0]);
+        vals_v.getVar({start}, {n}, &val_buf[0]);
+
+        _add_chunk(A, index_cols, val_buf, n,
+            std::integral_constant<bool, has_add_bulk<AccumulatorT>::value>());
+        start += n;
+    }
+}
+// -----------------------------------------------------------------
+/** @brief Writes A->dim_beginnings() to vname.dim_beginnings. */
+template<class ArrayT>
+void nc_write_dim_beginnings(
+    netCDF::NcGroup *nc,
+    ArrayT *A,
+    std::string const &vname);
+
+template<class ArrayT>
+void nc_write_dim_beginnings(
+    netCDF::NcGroup *nc,
+    ArrayT *A,
+    std::string const &vname)
+{
+    auto const &db(A->dim_beginnings());
+    std::vector<int64_t> db64(db.begin(), db.end());
+    nc->getVar(vname + ".dim_beginnings").putVar({0}, {db64.size()}, &db64[0]);
+}
+
+/** @brief Restores the sort order (and dim_beginnings, if stored) of
+a sparse array just read by ncio_spsparse().
+
+Does nothing if the file has no sort_order attribute.  If
+check_sorted, A is only marked sorted (and given the stored
+dim_beginnings) after is_sorted_by() confirms both, in one pass. */
+template<class ArrayT>
+void nc_read_sorted_state(
+    netCDF::NcGroup *nc,
+    ArrayT *A,
+    std::string const &vname,
+    bool check_sorted);
+
+template<class ArrayT>
+void nc_read_sorted_state(
+    netCDF::NcGroup *nc,
+    ArrayT *A,
+    std::string const &vname,
+    bool check_sorted)
+{
+    auto atts(nc->getVar(vname + ".info").getAtts());
+    auto ii(atts.find("sort_order"));
+    if (ii == atts.end()) return;
+
+    std::array<int, ArrayT::rank> sort_order;
+    ii->second.getValues(&sort_order[0]);
+
+    std::vector<size_t> db;
+    netCDF::NcVar db_v = nc->getVar(vname + ".dim_beginnings");
+    bool const has_db = !db_v.isNull();
+    if (has_db) {
+        size_t const n = db_v.getDim(0).getSize();
+        std::vector<int64_t> db64(n);
+        db_v.getVar({0}, {n}, &db64[0]);
+        db.assign(db64.begin(), db64.end());
+    }
+
+    if (check_sorted && !is_sorted_by(*A, sort_order, has_db ? &db : 0)) return;
+    A->set_sorted(sort_order);
+    if (has_db) A->set_dim_beginnings(std::move(db));
+}
 // -----------------------------------------------------------------
+/** @brief Internal helper for ncio_spsparse(): sets up NetCDF-4
+chunking and compression on a newly defined columnar variable. */
+inline void _set_nc_storage(
+    netCDF::NcVar &ncvar,
+    size_t size,
+    NcSparseOptions const &opts)
+{
+    // Zero-length fixed dimensions cannot be chunked
+    if (size == 0) return;
+
+    std::vector<size_t> chunks = {std::min(std::max((size_t)1, opts.storage_chunk), size)};
+    ncvar.setChunking(netCDF::NcVar::nc_CHUNKED, chunks);
+    if (opts.deflate_level > 0 || opts.shuffle)
+        ncvar.setCompression(opts.shuffle, opts.deflate_level > 0, opts.deflate_level);
+}
+// -----------------------------------------------------------------
+/** @brief Defines and writes (or reads) a sparse array.
+
+If A is sorted, its sort order is stored in a sort_order attribute on
+vname.info (and optionally its dim_beginnings(), see NcSparseOptions).
+When reading with alloc, that state is restored; so a consolidated
+array comes back consolidated, without a re-sort.
+
+@param alloc When reading, clear A and size it from the file;
+    otherwise, append the elements to A as it is.
+@param opts On-disk layout to write; on read, only opts.chunk_size
+    is used. */
 template<class ArrayT>
 void ncio_spsparse(
     ibmisc::NcIO &ncio,
     ArrayT &A,
     bool alloc,
-    std::string const &vname);
+    std::string const &vname,
+    NcSparseOptions const &opts);
 
 template<class ArrayT>
 void ncio_spsparse(
     ibmisc::NcIO &ncio,
     ArrayT &A,
     bool alloc,
-    std::string const &vname)
+    std::string const &vname,
+    NcSparseOptions const &opts)
 {
-    std::vector<std::string> const dim_names({vname + ".size", vname + ".rank"});
-    std::vector<netCDF::NcDim> dims;        // Dimensions in NetCDF
-
-    std::vector<size_t> dim_sizes;          // Length of our two dimensions.
+    const int RANK = ArrayT::rank;
 
     // Allocate the output, if we're reading
     if (ncio.rw == 'w') {
-        dims = ibmisc::get_or_add_dims(ncio, dim_names, {A.size(), A.rank});
-
         auto info_v = get_or_add_var(ncio, vname + ".info", "int64", {});
         info_v.putAtt("shape", netCDF::ncUint64, A.rank, &A.shape[0]);
 
-        get_or_add_var(ncio, vname + ".indices", "int64", dims);
-        get_or_add_var(ncio, vname + ".vals", netCDF::ncDouble, {dims[0]});
-        ncio += std::bind(&nc_write_spsparse<ArrayT>, ncio.nc, &A, vname);
+        // The sort order lets the reader skip a re-sort
+        bool const sorted = (A.sort_order[0] >= 0);
+        if (sorted) {
+            info_v.putAtt("sort_order", netCDF::ncInt, RANK, &A.sort_order[0]);
+
+            if (opts.dim_beginnings && A.size() > 0) {
+                auto db_dims = ibmisc::get_or_add_dims(ncio,
+                    {vname + ".dim_beginnings"}, {A.dim_beginnings().size()});
+                get_or_add_var(ncio, vname + ".dim_beginnings", "int64", db_dims);
+                ncio += std::bind(&nc_write_dim_beginnings<ArrayT>, ncio.nc, &A, vname);
+            }
+        }
+
+        if (opts.columnar) {
+            auto dims = ibmisc::get_or_add_dims(ncio, {vname + ".size"}, {A.size()});
+
+            for (int k=0; k<RANK; ++k) {
+                auto index_v = get_or_add_var(ncio, vname + ".index" + std::to_string(k),
+                    nc_index_type(A.shape[k]), dims);
+                if (ncio.define) _set_nc_storage(index_v, A.size(), opts);
+            }
+            auto vals_v = get_or_add_var(ncio, vname + ".vals", netCDF::ncDouble, dims);
+            if (ncio.define) _set_nc_storage(vals_v, A.size(), opts);
+
+            ncio += std::bind(&nc_write_spsparse_columnar<ArrayT>,
+                ncio.nc, &A, vname, opts.chunk_size);
+        } else {
+            auto dims = ibmisc::get_or_add_dims(ncio,
+                {vname + ".size", vname + ".rank"}, {A.size(), A.rank});
+
+            get_or_add_var(ncio, vname + ".indices", "int64", dims);
+            get_or_add_var(ncio, vname + ".vals", netCDF::ncDouble, {dims[0]});
+            ncio += std::bind(&nc_write_spsparse<ArrayT>,
+                ncio.nc, &A, vname, opts.chunk_size);
+        }
     } else {
-        dims = ibmisc::get_dims(ncio, dim_names);
+        bool const columnar = ncio.nc->getVar(vname + ".indices").isNull();
+        if (columnar) ibmisc::get_dims(ncio, {vname + ".size"});
+        else ibmisc::get_dims(ncio, {vname + ".size", vname + ".rank"});
 
         // Read
         netCDF::NcVar info_v = ncio.nc->getVar(vname + ".info");
@@ -151,10 +519,45 @@ void ncio_spsparse(
             A.reserve(ncio.nc->getDim(vname + ".size").getSize());
         }
 
-        ncio += std::bind(&nc_read_spsparse<ArrayT>, ncio.nc, &A, vname);
+        if (columnar) {
+            ncio += std::bind(&nc_read_spsparse_columnar<ArrayT>,
+                ncio.nc, &A, vname, opts.chunk_size);
+        } else {
+            ncio += std::bind(&nc_read_spsparse<ArrayT>,
+                ncio.nc, &A, vname, opts.chunk_size);
+        }
+
+        // A freshly allocated array holds exactly what was written;
+        // if that was sorted, so is A.
+        if (alloc) {
+            ncio += std::bind(&nc_read_sorted_state<ArrayT>,
+                ncio.nc, &A, vname, opts.check_sorted);
+        }
     }
 }
 
+/** @brief Reads/writes a sparse array in the original (non-columnar)
+layout, staging chunk_size elements at a time. */
+template<class ArrayT>
+void ncio_spsparse(
+    ibmisc::NcIO &ncio,
+    ArrayT &A,
+    bool alloc,
+    std::string const &vname,
+    size_t chunk_size = NC_CHUNK_SIZE);
+
+template<class ArrayT>
+void ncio_spsparse(
+    ibmisc::NcIO &ncio,
+    ArrayT &A,
+    bool alloc,
+    std::string const &vname,
+    size_t chunk_size)
+{
+    NcSparseOptions opts;
+    opts.chunk_size = chunk_size;
+    ncio_spsparse(ncio, A, alloc, vname, opts);
+}
 
 
 /** @} */
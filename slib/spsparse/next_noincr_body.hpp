@@ -20,6 +20,7 @@
         do {
 restart_loop: ;
             // Scan forward first iterator
+            xiter_skip_to(i1, next_match);
             for (;;++i1) {
                 if (i1.eof()) {
                     _eof = true;
@@ -35,6 +36,7 @@ restart_loop: ;
             // NOW: *i1 == next_match
 
 #if JOIN_RANK >= 2
+            xiter_skip_to(i2, next_match);
             for (;;++i2) {
                 if (i2.eof()) {
                     _eof = true;
@@ -51,6 +53,7 @@ restart_loop: ;
             // NOW: *i1 == *i2 == next_match
 
 #if JOIN_RANK >= 3
+            xiter_skip_to(i3, next_match);
             for (;;++i3) {
                 if (i3.eof()) {
                     _eof = true;
@@ -0,0 +1,97 @@
+/*
+ * IBMisc: Misc. Routines for IceBin (and other code)
+ * Copyright (c) 2013-2016 by Elizabeth Fischer
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPSPARSE_PARALLEL_HPP
+#define SPSPARSE_PARALLEL_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace spsparse {
+
+/** @defgroup parallel parallel.hpp
+@brief Simple thread helpers used by the multi-threaded algorithms.
+
+Multi-threading in SpSparse is always opt-in, through an nthreads
+parameter on the algorithm.  nthreads <= 1 runs everything on the
+calling thread.
+
+@{
+*/
+
+/** @brief Runs fn(tid) for tid = 0..nthreads-1, each on its own thread.
+
+tid=0 runs on the calling thread; the others are started afresh on
+each call (so their thread_arena() pools do not outlive the call).
+Returns once all threads have finished.  If any of them threw an exception, the first one (by tid)
+is rethrown here.
+
+Code Example
+@code
+std::vector<double> partial(nthreads);
+run_threads(nthreads, [&](int tid) {
+    for (size_t i=slice_begin(n, nthreads, tid); i<slice_begin(n, nthreads, tid+1); ++i)
+        partial[tid] += x[i];
+});
+@endcode
+*/
+template<class FnT>
+void run_threads(int nthreads, FnT const &fn)
+{
+    if (nthreads <= 1) {
+        fn(0);
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(nthreads);
+    std::vector<std::thread> threads;
+    threads.reserve(nthreads-1);
+    for (int tid=1; tid<nthreads; ++tid) {
+        threads.push_back(std::thread([&fn, &errors, tid]() {
+            try {
+                fn(tid);
+            } catch(...) {
+                errors[tid] = std::current_exception();
+            }
+        }));
+    }
+
+    try {
+        fn(0);
+    } catch(...) {
+        errors[0] = std::current_exception();
+    }
+
+    for (auto ii=threads.begin(); ii != threads.end(); ++ii) ii->join();
+    for (auto ii=errors.begin(); ii != errors.end(); ++ii)
+        if (*ii) std::rethrow_exception(*ii);
+}
+
+/** @brief Beginning of slice tid, when splitting [0,n) into nthreads
+nearly-equal contiguous slices.  Slice tid is [slice_begin(tid), slice_begin(tid+1)). */
+inline size_t slice_begin(size_t n, int nthreads, int tid)
+    { return (n / nthreads) * tid + std::min<size_t>(tid, n % nthreads); }
+
+/** @} */
+
+}   // Namespace
+
+#endif // Guard
@@ -19,7 +19,9 @@
 #ifndef XITER_HPP
 #define XITER_HPP
 
+#include <cstddef>
 #include <type_traits>
+#include <utility>
 
 namespace spsparse {
 
@@ -72,6 +74,51 @@ for (auto ii = A.begin(); ii != A.end(); ++ii)
 
 
 // -----------------------------------------------
+/** @brief True if IterT supports it += n and it1 - it2, so we can
+jump around in it instead of stepping one element at a time. */
+template<class IterT>
+class is_random_access
+{
+    template<class T>
+    static auto test(int) -> decltype(
+        std::declval<T &>() += 1,
+        std::declval<T const &>() - std::declval<T const &>(),
+        std::true_type());
+    template<class T>
+    static std::false_type test(...);
+public:
+    static const bool value = decltype(test<IterT>(0))::value;
+};
+
+/** @brief Galloping (exponential) search.
+
+Finds the first n in [0, len) for which !(key_at(n) < key), or len if
+there is none.  key_at(n) must be non-decreasing in n.  Takes
+O(log(n)) probes, so it is fast both for small jumps and for large
+ones.
+
+@param key_at Returns the key at position n. */
+template<class KeyAtT, class KeyT>
+size_t gallop(KeyAtT const &key_at, size_t len, KeyT const &key)
+{
+    if (len == 0 || !(key_at(0) < key)) return 0;
+
+    // Invariant: key_at(lo) < key; and hi==len or !(key_at(hi) < key)
+    size_t lo = 0;
+    size_t hi = 1;
+    while (hi < len && key_at(hi) < key) {
+        lo = hi;
+        hi *= 2;
+    }
+    if (hi > len) hi = len;
+
+    while (hi - lo > 1) {
+        size_t const mid = lo + (hi - lo) / 2;
+        if (key_at(mid) < key) lo = mid;
+        else hi = mid;
+    }
+    return hi;
+}
 // -----------------------------------------------
 /** @brief Convert standard STL iterator into our XIter.
 
@@ -111,6 +158,26 @@ public:
 
     /** @brief Pass-through, dereference the iterator. */
     auto operator*() -> decltype(*ii) { return *ii; }
+
+    /** @brief Move the iterator forward to the first value >= key
+    (or to eof).  Uses galloping search if STLIter is random-access;
+    steps one element at a time otherwise. */
+    template<class KeyT>
+    void skip_to(KeyT const &key)
+        { _skip_to(key, std::integral_constant<bool, is_random_access<STLIter>::value>()); }
+
+private:
+    template<class KeyT>
+    void _skip_to(KeyT const &key, std::false_type)
+        { while (ii != end && *ii < key) ++ii; }
+
+    template<class KeyT>
+    void _skip_to(KeyT const &key, std::true_type)
+    {
+        STLIter const base(ii);
+        ii += gallop([&base](size_t n) { STLIter jj(base); jj += n; return *jj; },
+            end - ii, key);
+    }
 };
 
 /** @brief Convert standard STL iterator (with extra .val() method)
@@ -145,7 +212,7 @@ public:
 
 template<class STLIter>
 STLXiter<STLIter> make_xiter(
-    STLIter **_begin, STLIter &&_end)
+    STLIter &&_begin, STLIter &&_end)
 { return STLXiter<STLIter>(std::move(_begin), std::move(_end)); }
 
 template<class ValSTLIter>
@@ -160,6 +227,22 @@ ValSTLXiter<ValSTLIter> make_val_xiter(
 
 
 
+// -------------------------------------------------------
+/** @brief Internal helper for Join2Xiter and Join3Xiter.
+
+Calls ii.skip_to(key) if the Xiter has it; otherwise does nothing, and
+the caller steps forward one element at a time. */
+template<class XiterT, class KeyT>
+auto _xiter_skip_to(XiterT &ii, KeyT const &key, int) -> decltype(ii.skip_to(key), void())
+    { ii.skip_to(key); }
+
+template<class XiterT, class KeyT>
+void _xiter_skip_to(XiterT &, KeyT const &, long) {}
+
+template<class XiterT, class KeyT>
+void xiter_skip_to(XiterT &ii, KeyT const &key)
+    { _xiter_skip_to(ii, key, 0); }
+
 // -------------------------------------------------------
 /** @brief Joins three (sorted, non-repeating) Xiters.  See Join2Xiter.
 @see Join2Xiter
@@ -20,6 +20,7 @@
 
 #include <gtest/gtest.h>
 #include <ibmisc/netcdf.hpp>
+#include <ibmisc/indexing.hpp>
 #include <iostream>
 #include <cstdio>
 #include <netcdf>
@@ -155,6 +156,72 @@ TEST_F(NetcdfTest, blitz)
 
 }
 
+TEST_F(NetcdfTest, blitz_hyperslab)
+{
+    std::string fname("__netcdf_hyperslab_test.nc");
+    tmpfiles.push_back(fname);
+
+    ::remove(fname.c_str());
+
+    blitz::Array<double,2> A(6,5);
+    for (int i=0; i<A.extent(0); ++i) {
+    for (int j=0; j<A.extent(1); ++j) {
+      A(i,j) = i*10 + j;
+    }}
+
+    // ---------- Write in two pieces: rows [0,4) and [4,6)
+    {
+        ibmisc::NcIO ncio(fname, NcFile::replace);
+        auto dims = ibmisc::get_or_add_dims(ncio, {"dim6", "dim5"}, {6, 5});
+
+        blitz::Array<double,2> top(4,5), bottom(2,5);   // Zero-based
+        for (int i=0; i<4; ++i) for (int j=0; j<5; ++j) top(i,j) = A(i,j);
+        for (int i=0; i<2; ++i) for (int j=0; j<5; ++j) bottom(i,j) = A(i+4,j);
+
+        ibmisc::ncio_blitz(ncio, top, false, "A", netCDF::ncDouble, dims,
+            Domain<int>({0,0}, {4,5}));
+        ibmisc::ncio_blitz(ncio, bottom, false, "A", netCDF::ncDouble, dims,
+            {4,0}, {2,5});
+
+        // Extent of val must match the hyperslab
+        EXPECT_THROW(ibmisc::ncio_blitz(ncio, bottom, false, "A", netCDF::ncDouble, dims,
+            {4,0}, {2,4}), ibmisc::Exception);
+        ncio.close();
+    }
+
+    // ---------- Read pieces back
+    ibmisc::NcIO ncio(fname, NcFile::read);
+    auto dims = ibmisc::get_dims(ncio, {"dim6", "dim5"});
+
+    blitz::Array<double,2> A2, A3;
+    ibmisc::ncio_blitz(ncio, A2, true, "A", netCDF::ncDouble, dims,
+        {2,1}, {3,3});
+    ibmisc::ncio_blitz(ncio, A3, true, "A", netCDF::ncDouble, dims,
+        Domain<int>({3,0}, {6,5}));
+    blitz::Array<double,2> A4(nc_read_blitz<double,2>(ncio.nc, "A", {1,2}, {1,3}));
+
+    // Outside the variable
+    blitz::Array<double,2> A5;
+    EXPECT_THROW(ibmisc::ncio_blitz(ncio, A5, true, "A", netCDF::ncDouble, dims,
+        {4,0}, {3,5}), ibmisc::Exception);
+    ncio.close();
+
+    // Arrays are based at the start of the hyperslab
+    EXPECT_EQ(2, A2.lbound(0));
+    EXPECT_EQ(1, A2.lbound(1));
+    EXPECT_EQ(3, A2.extent(0));
+    EXPECT_EQ(3, A2.extent(1));
+    for (int i=2; i<5; ++i) for (int j=1; j<4; ++j) EXPECT_EQ(A(i,j), A2(i,j));
+
+    EXPECT_EQ(3, A3.lbound(0));
+    EXPECT_EQ(0, A3.lbound(1));
+    for (int i=3; i<6; ++i) for (int j=0; j<5; ++j) EXPECT_EQ(A(i,j), A3(i,j));
+
+    EXPECT_EQ(1, A4.lbound(0));
+    EXPECT_EQ(2, A4.lbound(1));
+    for (int j=2; j<5; ++j) EXPECT_EQ(A(1,j), A4(1,j));
+}
+
 TEST_F(NetcdfTest, vector)
 {
     std::string fname("__netcdf_vector_test.nc");
@@ -0,0 +1,122 @@
+/*
+ * IBMisc: Misc. Routines for IceBin (and other code)
+ * Copyright (c) 2013-2016 by Elizabeth Fischer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Parallel (MPI-IO) NetCDF tests.  Run with, eg:
+//     mpirun -np 4 ibmisc_netcdf_mpi
+
+#include <gtest/gtest.h>
+#include <mpi.h>
+#include <ibmisc/netcdf.hpp>
+#include <ibmisc/indexing.hpp>
+#include <iostream>
+#include <cstdio>
+#include <netcdf>
+
+using namespace ibmisc;
+using namespace netCDF;
+
+// The fixture for testing class Foo.
+class NetcdfMpiTest : public ::testing::Test {
+protected:
+
+    int mpi_rank, mpi_size;
+
+    // You can do set-up work for each test here.
+    NetcdfMpiTest()
+    {
+        MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &mpi_size);
+    }
+
+    // Rows [low, high) of an nrow-row grid owned by this rank
+    Domain<int> row_domain(int nrow, int ncol)
+    {
+        int const low = (nrow * mpi_rank) / mpi_size;
+        int const high = (nrow * (mpi_rank+1)) / mpi_size;
+        return Domain<int>({low, 0}, {high, ncol});
+    }
+};
+
+TEST_F(NetcdfMpiTest, blitz_domain)
+{
+    std::string fname("__netcdf_mpi_blitz_test.nc");
+    int const nrow = 2*mpi_size + 1;    // Uneven split
+    int const ncol = 5;
+
+    // Each rank fills just its own rows, indexed globally
+    Domain<int> domain(row_domain(nrow, ncol));
+    blitz::Array<double,2> A(
+        blitz::shape(domain.low[0], 0),
+        blitz::shape(domain.high[0] - domain.low[0], ncol));
+    for (int i=domain.low[0]; i<domain.high[0]; ++i) {
+    for (int j=0; j<ncol; ++j) {
+        A(i,j) = i*ncol + j;
+    }}
+
+    std::vector<double> vec;
+    for (int i=domain.low[0]; i<domain.high[0]; ++i) vec.push_back(i+1);
+    Domain<int> vdomain({domain.low[0]}, {domain.high[0]});
+
+    // ---------- Write: collective, one hyperslab per rank
+    {
+        NcIO ncio(fname, NcFile::replace, MPI_COMM_WORLD);
+        EXPECT_TRUE(ncio.parallel);
+        auto dims = get_or_add_dims(ncio, {"nrow", "ncol"},
+            {(size_t)nrow, (size_t)ncol});
+        ncio_blitz(ncio, A, false, "A", ncDouble, dims, domain);
+        ncio_vector(ncio, vec, false, "vec", ncDouble, {dims[0]}, vdomain);
+        ncio.close();
+    }
+
+    // ---------- Read: every rank reads another rank's rows
+    {
+        int const other = (mpi_rank + 1) % mpi_size;
+        int const low = (nrow * other) / mpi_size;
+        int const high = (nrow * (other+1)) / mpi_size;
+
+        NcIO ncio(fname, NcFile::read, MPI_COMM_WORLD);
+        auto dims = get_dims(ncio, {"nrow", "ncol"});
+
+        blitz::Array<double,2> A2;
+        ncio_blitz(ncio, A2, true, "A", ncDouble, dims,
+            Domain<int>({low, 0}, {high, ncol}));
+        std::vector<double> vec2;
+        ncio_vector(ncio, vec2, true, "vec", ncDouble, {dims[0]},
+            Domain<int>({low}, {high}));
+        ncio.close();
+
+        EXPECT_EQ(low, A2.lbound(0));
+        EXPECT_EQ(high - low, A2.extent(0));
+        for (int i=low; i<high; ++i) {
+            for (int j=0; j<ncol; ++j) EXPECT_EQ(i*ncol + j, A2(i,j));
+            EXPECT_EQ(i+1, vec2[i-low]);
+        }
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (mpi_rank == 0) ::remove(fname.c_str());
+}
+
+
+int main(int argc, char **argv) {
+    MPI_Init(&argc, &argv);
+    ::testing::InitGoogleTest(&argc, argv);
+    int ret = RUN_ALL_TESTS();
+    MPI_Finalize();
+    return ret;
+}
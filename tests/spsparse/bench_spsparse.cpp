@@ -0,0 +1,330 @@
+/*
+ * IBMisc: Misc. Routines for IceBin (and other code)
+ * Copyright (c) 2013-2016 by Elizabeth Fischer
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Benchmarks for the SpSparse kernels, using Google Benchmark.
+//
+// Matrices are synthetic "regrid-like": each row has a few non-zeros
+// in nearby columns, with twice as many columns as rows.  Each
+// benchmark takes (nrows, nnz_per_row) as arguments.
+//
+// Usage:
+//     spsparse_bench --benchmark_filter=multiply \
+//         --benchmark_out=bench.json --benchmark_out_format=json
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <benchmark/benchmark.h>
+#include <spsparse/VectorCooArray.hpp>
+#include <spsparse/multiply_sparse.hpp>
+#include <spsparse/multiply_dense.hpp>
+#include <spsparse/PackedCompressedArray.hpp>
+#include <spsparse/eigen.hpp>
+#ifdef USE_NETCDF
+#include <spsparse/netcdf.hpp>
+#endif
+
+using namespace spsparse;
+
+typedef VectorCooMatrix<int, double> MatrixT;
+typedef VectorCooVector<int, double> VectorT;
+
+/** Regrid-like matrix of shape (nrows, 2*nrows), with rows in random order. */
+static MatrixT regrid_matrix(int nrows, int nnz_per_row, bool consolidated)
+{
+    int const ncols = 2 * nrows;
+    std::default_random_engine generator(17);
+    std::uniform_real_distribution<double> val_distro(0,1);
+
+    std::vector<int> rows(nrows);
+    for (int i=0; i<nrows; ++i) rows[i] = i;
+    std::shuffle(rows.begin(), rows.end(), generator);
+
+    MatrixT A({(size_t)nrows, (size_t)ncols});
+    A.reserve((size_t)nrows * nnz_per_row);
+    for (auto ii=rows.begin(); ii != rows.end(); ++ii) {
+        int const i = *ii;
+        for (int k=0; k<nnz_per_row; ++k)
+            A.add({i, (2*i + 3*k) % ncols}, val_distro(generator));
+    }
+    if (consolidated) A.consolidate({0,1});
+    return A;
+}
+
+static VectorT dense_vector(size_t n)
+{
+    std::default_random_engine generator(18);
+    std::uniform_real_distribution<double> val_distro(0,1);
+    VectorT V({n});
+    for (size_t j=0; j<n; ++j) V.add({(int)j}, val_distro(generator));
+    V.consolidate({0});
+    return V;
+}
+
+static void regrid_args(benchmark::internal::Benchmark *b)
+{
+    b->Args({10000, 4})->Args({100000, 4})->Args({100000, 16})->Unit(benchmark::kMillisecond);
+}
+
+// Sizes small enough to make dense
+static void dense_args(benchmark::internal::Benchmark *b)
+{
+    b->Args({1000, 4})->Args({2000, 16})->Unit(benchmark::kMillisecond);
+}
+// -----------------------------------------------------------
+static void BM_consolidate(benchmark::State &state)
+{
+    MatrixT A(regrid_matrix(state.range(0), state.range(1), false));
+    for (auto _ : state) {
+        MatrixT ret(A.shape);
+        consolidate(ret, A, {0,1});
+        benchmark::DoNotOptimize(ret.size());
+    }
+    state.SetItemsProcessed(state.iterations() * A.size());
+}
+BENCHMARK(BM_consolidate)->Apply(regrid_args);
+
+static void BM_consolidate_threaded(benchmark::State &state)
+{
+    MatrixT A(regrid_matrix(state.range(0), state.range(1), false));
+    for (auto _ : state) {
+        MatrixT ret(A.shape);
+        consolidate(ret, A, {0,1}, DuplicatePolicy::ADD, false, 4);
+        benchmark::DoNotOptimize(ret.size());
+    }
+    state.SetItemsProcessed(state.iterations() * A.size());
+}
+BENCHMARK(BM_consolidate_threaded)->Apply(regrid_args);
+
+// Duplicates summed without sorting; compare to BM_consolidate
+static void BM_hash_accum(benchmark::State &state)
+{
+    MatrixT A(regrid_matrix(state.range(0), state.range(1), false));
+    for (auto _ : state) {
+        HashAccum<MatrixT> hash(A.shape, DuplicatePolicy::ADD, false, A.size());
+        copy(hash, A);
+        MatrixT ret(A.shape);
+        hash.emit(ret);
+        benchmark::DoNotOptimize(ret.size());
+    }
+    state.SetItemsProcessed(state.iterations() * A.size());
+}
+BENCHMARK(BM_hash_accum)->Apply(regrid_args);
+
+static void BM_dim_beginnings(benchmark::State &state)
+{
+    MatrixT A(regrid_matrix(state.range(0), state.range(1), true));
+    for (auto _ : state) {
+        auto db(dim_beginnings(A));
+        benchmark::DoNotOptimize(db.data());
+    }
+    state.SetItemsProcessed(state.iterations() * A.size());
+}
+BENCHMARK(BM_dim_beginnings)->Apply(regrid_args);
+
+static void BM_transpose(benchmark::State &state)
+{
+    MatrixT A(regrid_matrix(state.range(0), state.range(1), true));
+    for (auto _ : state) {
+        MatrixT ret({A.shape[1], A.shape[0]});
+        transpose(ret, A, {1,0});
+        benchmark::DoNotOptimize(ret.size());
+    }
+    state.SetItemsProcessed(state.iterations() * A.size());
+}
+BENCHMARK(BM_transpose)->Apply(regrid_args);
+
+static void BM_to_dense(benchmark::State &state)
+{
+    MatrixT A(regrid_matrix(state.range(0), state.range(1), true));
+    for (auto _ : state) {
+        auto dense(A.to_dense());
+        benchmark::DoNotOptimize(dense.data());
+    }
+    state.SetItemsProcessed(state.iterations() * A.size());
+}
+BENCHMARK(BM_to_dense)->Apply(dense_args);
+
+static void BM_to_dense_threaded(benchmark::State &state)
+{
+    MatrixT A(regrid_matrix(state.range(0), state.range(1), true));
+    for (auto _ : state) {
+        auto dense(A.to_dense(0, 4));
+        benchmark::DoNotOptimize(dense.data());
+    }
+    state.SetItemsProcessed(state.iterations() * A.size());
+}
+BENCHMARK(BM_to_dense_threaded)->Apply(dense_args);
+
+// Scatter alone (no allocation or fill), vs. copy() into a DenseAccum
+static void BM_dense_scatter(benchmark::State &state)
+{
+    MatrixT A(regrid_matrix(state.range(0), state.range(1), false));
+    blitz::Array<double,2> dense(A.shape[0], A.shape[1]);
+    dense = 0;
+    for (auto _ : state) {
+        if (state.range(2)) {
+            dense_scatter(dense, A);
+        } else {
+            DenseAccum<MatrixT> accum(dense);
+            copy(accum, A);
+        }
+        benchmark::DoNotOptimize(dense.data());
+    }
+    state.SetItemsProcessed(state.iterations() * A.size());
+}
+BENCHMARK(BM_dense_scatter)->Args({2000, 16, 0})->Args({2000, 16, 1})->Unit(benchmark::kMillisecond);
+// -----------------------------------------------------------
+static void BM_multiply_MV(benchmark::State &state)
+{
+    MatrixT A(regrid_matrix(state.range(0), state.range(1), true));
+    VectorT V(dense_vector(A.shape[1]));
+    for (auto _ : state) {
+        VectorT ret;
+        multiply(ret, 1.0, (VectorT *)0, A, '.', (VectorT *)0, V);
+        benchmark::DoNotOptimize(ret.size());
+    }
+    state.SetItemsProcessed(state.iterations() * A.size());
+}
+BENCHMARK(BM_multiply_MV)->Apply(regrid_args);
+
+static void BM_multiply_MV_threaded(benchmark::State &state)
+{
+    MatrixT A(regrid_matrix(state.range(0), state.range(1), true));
+    VectorT V(dense_vector(A.shape[1]));
+    for (auto _ : state) {
+        VectorT ret;
+        multiply(ret, 1.0, (VectorT *)0, A, '.', (VectorT *)0, V,
+            DuplicatePolicy::ADD, false, 4);
+        benchmark::DoNotOptimize(ret.size());
+    }
+    state.SetItemsProcessed(state.iterations() * A.size());
+}
+BENCHMARK(BM_multiply_MV_threaded)->Apply(regrid_args);
+
+// Third argument: handle_nan
+static void BM_multiply_dense(benchmark::State &state)
+{
+    MatrixT A(regrid_matrix(state.range(0), state.range(1), true));
+    bool const handle_nan = state.range(2);
+    blitz::Array<double,1> x(A.shape[1]);
+    for (int j=0; j<A.shape[1]; ++j) x(j) = 1.0 / (j+1);
+    blitz::Array<double,1> y(A.shape[0]);
+    DenseAccum<VectorT> yaccum(y);
+    for (auto _ : state) {
+        y = 0;
+        multiply(yaccum, A, x, handle_nan);
+        benchmark::DoNotOptimize(y.data());
+    }
+    state.SetItemsProcessed(state.iterations() * A.size());
+}
+BENCHMARK(BM_multiply_dense)
+    ->Args({10000, 4, 0})->Args({100000, 4, 0})->Args({100000, 16, 0})
+    ->Args({100000, 16, 1})->Unit(benchmark::kMillisecond);
+
+static void BM_multiply_dense_packed(benchmark::State &state)
+{
+    MatrixT A(regrid_matrix(state.range(0), state.range(1), true));
+    PackedCsrArray<int, double> Apacked(A);
+    blitz::Array<double,1> x(A.shape[1]);
+    for (int j=0; j<A.shape[1]; ++j) x(j) = 1.0 / (j+1);
+    blitz::Array<double,1> y(A.shape[0]);
+    DenseAccum<VectorT> yaccum(y);
+    for (auto _ : state) {
+        y = 0;
+        multiply(yaccum, Apacked, x);
+        benchmark::DoNotOptimize(y.data());
+    }
+    state.SetItemsProcessed(state.iterations() * A.size());
+    state.counters["bytes_per_nnz"] = (double)Apacked.nbytes() / A.size();
+}
+BENCHMARK(BM_multiply_dense_packed)->Apply(regrid_args);
+
+static void BM_multiply_batch(benchmark::State &state)
+{
+    int const nfield = 32;
+    MatrixT A(regrid_matrix(state.range(0), state.range(1), true));
+    blitz::Array<double,2> X(nfield, A.shape[1]);
+    for (int f=0; f<nfield; ++f)
+    for (int j=0; j<A.shape[1]; ++j) X(f,j) = 1.0 / (f+j+1);
+    blitz::Array<double,2> Y(nfield, A.shape[0]);
+    for (auto _ : state) {
+        Y = 0;
+        multiply_batch(Y, 1.0, (VectorT *)0, A, '.', (VectorT *)0, X);
+        benchmark::DoNotOptimize(Y.data());
+    }
+    state.SetItemsProcessed(state.iterations() * A.size() * nfield);
+}
+BENCHMARK(BM_multiply_batch)->Apply(regrid_args);
+
+static void BM_multiply_MM(benchmark::State &state)
+{
+    // (nrows x ncols) * (ncols x nrows)
+    MatrixT A(regrid_matrix(state.range(0), state.range(1), true));
+    for (auto _ : state) {
+        MatrixT ret;
+        multiply(ret, 1.0, (VectorT *)0, A, '.', (VectorT *)0, A, 'T', (VectorT *)0);
+        benchmark::DoNotOptimize(ret.size());
+    }
+    state.SetItemsProcessed(state.iterations() * A.size());
+}
+BENCHMARK(BM_multiply_MM)->Apply(regrid_args);
+// -----------------------------------------------------------
+static void BM_to_eigen(benchmark::State &state)
+{
+    typedef SparseTriplets<MatrixT> TripletsT;
+    MatrixT A(regrid_matrix(state.range(0), state.range(1), true));
+    TripletsT::SparseSetT dimi, dimj;
+    TripletsT At({&dimi, &dimj});
+    At.set_shape(A.shape);
+    for (auto ii=A.begin(); ii != A.end(); ++ii) At.add(ii.index(), ii.val());
+
+    for (auto _ : state) {
+        auto Ae(At.to_eigen());
+        benchmark::DoNotOptimize(Ae.nonZeros());
+    }
+    state.SetItemsProcessed(state.iterations() * A.size());
+}
+BENCHMARK(BM_to_eigen)->Apply(regrid_args);
+// -----------------------------------------------------------
+#ifdef USE_NETCDF
+static void BM_netcdf_roundtrip(benchmark::State &state)
+{
+    MatrixT A(regrid_matrix(state.range(0), state.range(1), true));
+    std::string const fname("__spsparse_bench.nc");
+    for (auto _ : state) {
+        {
+            ibmisc::NcIO ncio(fname, netCDF::NcFile::replace);
+            ncio_spsparse(ncio, A, true, "A");
+            ncio.close();
+        }
+        MatrixT A2;
+        {
+            ibmisc::NcIO ncio(fname, netCDF::NcFile::read);
+            ncio_spsparse(ncio, A2, true, "A");
+            ncio.close();
+        }
+        benchmark::DoNotOptimize(A2.size());
+    }
+    ::remove(fname.c_str());
+    state.SetItemsProcessed(state.iterations() * A.size());
+}
+BENCHMARK(BM_netcdf_roundtrip)->Args({10000, 4})->Args({100000, 4})->Unit(benchmark::kMillisecond);
+#endif
+
+BENCHMARK_MAIN();
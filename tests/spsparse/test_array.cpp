@@ -20,8 +20,12 @@
 
 #include <gtest/gtest.h>
 #include <spsparse/VectorCooArray.hpp>
+#include <spsparse/CompressedArray.hpp>
+#include <spsparse/PackedCompressedArray.hpp>
+#include <spsparse/MmapCooArray.hpp>
 #include <spsparse/SparseSet.hpp>
 #include <iostream>
+#include <random>
 #ifdef USE_EVERYTRACE
 #include <everytrace.h>
 #endif
@@ -82,6 +86,48 @@ TEST_F(SpSparseTest, VectorCooArray) {
     EXPECT_EQ(2., arr2.val(0));
 }
 
+TEST_F(SpSparseTest, add_bulk) {
+    std::vector<int> ii {1, 0, 1, 3};
+    std::vector<int> jj {2, 2, 0, 4};
+    std::vector<double> vv {1., 2., 3., 4.};
+
+    VectorCooArray<int, double, 2> expected({4,5});
+    for (size_t n=0; n<vv.size(); ++n) expected.add({ii[n], jj[n]}, vv[n]);
+
+    // Appends after what is already there
+    VectorCooArray<int, double, 2> arr({4,5});
+    arr.add({ii[0], jj[0]}, vv[0]);
+    arr.add_bulk({&ii[1], &jj[1]}, &vv[1], 3);
+    EXPECT_EQ(to_vector(expected.indices(0)), to_vector(arr.indices(0)));
+    EXPECT_EQ(to_vector(expected.indices(1)), to_vector(arr.indices(1)));
+    EXPECT_EQ(to_vector(expected.vals()), to_vector(arr.vals()));
+
+    // Strided Blitz columns
+    blitz::Array<int,2> ij(4,2);
+    blitz::Array<double,1> vals(4);
+    for (int n=0; n<4; ++n) {
+        ij(n,0) = ii[n];
+        ij(n,1) = jj[n];
+        vals(n) = vv[n];
+    }
+    VectorCooArray<int, double, 2> arrb({4,5});
+    arrb.add_bulk({ij(blitz::Range::all(),0), ij(blitz::Range::all(),1)}, vals);
+    EXPECT_EQ(to_vector(expected.indices(0)), to_vector(arrb.indices(0)));
+    EXPECT_EQ(to_vector(expected.indices(1)), to_vector(arrb.indices(1)));
+    EXPECT_EQ(to_vector(expected.vals()), to_vector(arrb.vals()));
+
+    // Test bounds checking
+    jj[2] = 5;
+    try {
+        arr.add_bulk({&ii[0], &jj[0]}, &vv[0], 4);
+        FAIL() << "Excpected spsparse::Exception";
+    } catch(spsparse::Exception const &err) {
+    } catch(...) {
+        FAIL() << "Excpected spsparse::Exception";
+    }
+    EXPECT_EQ(4, arr.size());
+}
+
 /** Check that we can get sorted permutations properly. */
 TEST_F(SpSparseTest, permutation) {
     VectorCooArray<int, double, 2> arr2({2,4});
@@ -98,6 +144,50 @@ TEST_F(SpSparseTest, permutation) {
 }
 
 
+/** Check the radix sort path against the comparator sort. */
+TEST_F(SpSparseTest, radix_permutation) {
+    std::default_random_engine generator(17);
+    std::uniform_int_distribution<int> dim0(0, 999);
+    std::uniform_int_distribution<int> dim1(0, 49);
+
+    VectorCooArray<int, double, 2> arr2({1000,50});
+    for (int i=0; i<5000; ++i) arr2.add({dim0(generator), dim1(generator)}, (double)i);
+
+    for (auto sort_order : {std::array<int,2>{0,1}, std::array<int,2>{1,0}}) {
+        std::vector<size_t> perm;
+        EXPECT_TRUE(radix_sorted_permutation(perm, arr2, sort_order));
+
+        std::vector<size_t> perm_cmp(arr2.size());
+        for (size_t i=0; i<perm_cmp.size(); ++i) perm_cmp[i] = i;
+        std::stable_sort(perm_cmp.begin(), perm_cmp.end(),
+            CmpIndex<decltype(arr2)>(&arr2, sort_order));
+
+        EXPECT_EQ(perm_cmp, perm);
+        EXPECT_EQ(perm_cmp, sorted_permutation(arr2, sort_order));
+    }
+
+    // 28-bit keys (three passes, odd) and 40-bit keys (64-bit key path)
+    for (long extent : {1L << 14, 1L << 20}) {
+        std::uniform_int_distribution<long> dimx(0, extent-1);
+        VectorCooArray<long, double, 2> arr4({(size_t)extent, (size_t)extent});
+        for (int i=0; i<5000; ++i) arr4.add({dimx(generator), dimx(generator) % 7}, (double)i);
+
+        std::vector<size_t> perm;
+        EXPECT_TRUE(radix_sorted_permutation(perm, arr4, {1,0}));
+
+        std::vector<size_t> perm_cmp(arr4.size());
+        for (size_t i=0; i<perm_cmp.size(); ++i) perm_cmp[i] = i;
+        std::stable_sort(perm_cmp.begin(), perm_cmp.end(),
+            CmpIndex<decltype(arr4)>(&arr4, {1,0}));
+        EXPECT_EQ(perm_cmp, perm);
+    }
+
+    // Shape not set: radix path must decline
+    VectorCooArray<int, double, 2> arr3;
+    std::vector<size_t> perm3;
+    EXPECT_FALSE(radix_sorted_permutation(perm3, arr3, {0,1}));
+}
+
 TEST_F(SpSparseTest, iterators) {
     VectorCooArray<int, double, 2> arr2({2,4});
     arr2.add({1,3}, 5.);
@@ -186,6 +276,182 @@ TEST_F(SpSparseTest, consolidate) {
 
 }
 
+/** In-place consolidate must give the same result as consolidating into a copy. */
+TEST_F(SpSparseTest, inplace_consolidate)
+{
+    std::default_random_engine generator(29);
+    std::uniform_int_distribution<int> dim0(0, 49);
+    std::uniform_int_distribution<int> dim1(0, 9);
+    std::uniform_int_distribution<int> ival(0, 4);
+
+    VectorCooArray<int, double, 2> arr2({50,10});
+    for (int i=0; i<5000; ++i) {
+        int const v = ival(generator);
+        arr2.add({dim0(generator), dim1(generator)}, v == 4 ? NAN : (double)v);
+    }
+
+    for (bool zero_nan : {false, true}) {
+    for (auto policy : {DuplicatePolicy::ADD, DuplicatePolicy::LEAVE_ALONE, DuplicatePolicy::REPLACE}) {
+    for (auto sort_order : {std::array<int,2>{0,1}, std::array<int,2>{1,0}}) {
+        VectorCooArray<int, double, 2> copied(arr2.shape);
+        consolidate(copied, arr2, sort_order, policy, zero_nan);
+
+        VectorCooArray<int, double, 2> inplace(arr2);
+        inplace.consolidate(sort_order, policy, zero_nan);
+
+        EXPECT_EQ(sort_order, inplace.sort_order);
+        EXPECT_EQ(to_vector(copied.indices(0)), to_vector(inplace.indices(0)));
+        EXPECT_EQ(to_vector(copied.indices(1)), to_vector(inplace.indices(1)));
+        auto cv(to_vector(copied.vals()));
+        auto iv(to_vector(inplace.vals()));
+        ASSERT_EQ(cv.size(), iv.size());
+        for (size_t i=0; i<cv.size(); ++i) {
+            if (std::isnan(cv[i])) EXPECT_TRUE(std::isnan(iv[i]));
+            else EXPECT_EQ(cv[i], iv[i]);
+        }
+        EXPECT_EQ(dim_beginnings(copied), inplace.dim_beginnings());
+    }}}
+
+    // Editing after consolidation must not leave stale dim_beginnings
+    VectorCooArray<int, double, 2> arr3({3,3});
+    arr3.add({0,0}, 1.);
+    arr3.consolidate({0,1});
+    EXPECT_EQ(std::vector<size_t>({0,1}), arr3.dim_beginnings());
+    arr3.edit();
+    arr3.add({2,1}, 1.);
+    arr3.consolidate({0,1});
+    EXPECT_EQ(std::vector<size_t>({0,1,2}), arr3.dim_beginnings());
+}
+
+/** Consolidating a consolidated prefix plus a new tail must give the
+same result as consolidating everything from scratch. */
+TEST_F(SpSparseTest, incremental_consolidate)
+{
+    std::default_random_engine generator(31);
+    std::uniform_int_distribution<int> dim0(0, 49);
+    std::uniform_int_distribution<int> dim1(0, 9);
+    std::uniform_int_distribution<int> ival(0, 3);
+
+    for (bool zero_nan : {false, true}) {
+    for (auto policy : {DuplicatePolicy::ADD, DuplicatePolicy::LEAVE_ALONE, DuplicatePolicy::REPLACE}) {
+    for (auto sort_order : {std::array<int,2>{0,1}, std::array<int,2>{1,0}}) {
+    for (int ntail : {0, 1, 30, 3000}) {
+        VectorCooArray<int, double, 2> all({50,10});
+        VectorCooArray<int, double, 2> incr({50,10});
+        for (int i=0; i<2000 + ntail; ++i) {
+            if (i == 2000) incr.consolidate(sort_order, policy, zero_nan);
+            std::array<int,2> const idx {dim0(generator), dim1(generator)};
+            int const v = ival(generator);
+            double const val = (zero_nan && v == 3) ? NAN : (double)v;
+            all.add(idx, val);
+            if (i >= 2000) incr.edit();
+            incr.add(idx, val);
+        }
+        incr.consolidate(sort_order, policy, zero_nan);
+
+        VectorCooArray<int, double, 2> expected(all.shape);
+        consolidate(expected, all, sort_order, policy, zero_nan);
+
+        EXPECT_EQ(sort_order, incr.sort_order);
+        EXPECT_EQ(to_vector(expected.indices(0)), to_vector(incr.indices(0)));
+        EXPECT_EQ(to_vector(expected.indices(1)), to_vector(incr.indices(1)));
+        EXPECT_EQ(to_vector(expected.vals()), to_vector(incr.vals()));
+        EXPECT_EQ(dim_beginnings(expected), incr.dim_beginnings());
+    }}}}
+}
+
+TEST_F(SpSparseTest, pooled_array)
+{
+    // Freed blocks are handed back out for the same size class
+    ArenaPool pool;
+    void *p1 = pool.allocate(1000);
+    pool.deallocate(p1, 1000);
+    EXPECT_EQ(1024, pool.cached_bytes());
+    EXPECT_EQ(p1, pool.allocate(1000));
+    EXPECT_EQ(0, pool.cached_bytes());
+    pool.deallocate(p1, 1000);
+
+    // Large blocks are recycled too, once the cap allows
+    size_t const big = ((size_t)1 << 27) + 1;
+    pool.deallocate(pool.allocate(big), big);
+    EXPECT_EQ(1024, pool.cached_bytes());
+    pool.max_cached_bytes = (size_t)1 << 30;
+    void *p2 = pool.allocate(big);
+    pool.deallocate(p2, big);
+    EXPECT_EQ(1024 + ((size_t)1 << 28), pool.cached_bytes());
+    EXPECT_EQ(p2, pool.allocate(big));
+    pool.deallocate(p2, big);
+
+    // Total cached bytes are capped
+    ArenaPool small_pool(16, 4096);
+    std::vector<void *> blocks;
+    for (int i=0; i<8; ++i) blocks.push_back(small_pool.allocate(1000));
+    for (void *p : blocks) small_pool.deallocate(p, 1000);
+    EXPECT_EQ(4096, small_pool.cached_bytes());
+
+    std::default_random_engine generator(23);
+    std::uniform_int_distribution<int> dim0(0, 99);
+    std::uniform_int_distribution<int> dim1(0, 9);
+
+    VectorCooArray<int, double, 2> arr({100,10});
+    PooledVectorCooArray<int, double, 2> parr({100,10});
+    for (int i=0; i<2000; ++i) {
+        int const ix = dim0(generator);
+        int const jx = dim1(generator);
+        arr.add({ix, jx}, (double)i);
+        parr.add({ix, jx}, (double)i);
+    }
+
+    arr.consolidate({0,1});
+    parr.consolidate({0,1});
+    EXPECT_EQ(to_vector(arr.indices(0)), to_vector(parr.indices(0)));
+    EXPECT_EQ(to_vector(arr.indices(1)), to_vector(parr.indices(1)));
+    EXPECT_EQ(to_vector(arr.vals()), to_vector(parr.vals()));
+
+    // The original columns went back to this thread's pool
+    EXPECT_LT(0, thread_arena().cached_bytes());
+    thread_arena().release();
+    EXPECT_EQ(0, thread_arena().cached_bytes());
+
+    // Destroying a pool of one's own leaves this thread's pool in use
+    { ArenaPool local_pool; }
+    { PooledVector<double> vec(1000); }
+    EXPECT_LT(0, thread_arena().cached_bytes());
+    thread_arena().release();
+}
+
+/** Multi-threaded consolidate must give exactly the serial result. */
+TEST_F(SpSparseTest, parallel_consolidate)
+{
+    std::default_random_engine generator(23);
+    std::uniform_int_distribution<int> dim0(0, 99);
+    std::uniform_int_distribution<int> dim1(0, 9);
+    std::uniform_int_distribution<int> ival(0, 4);
+
+    VectorCooArray<int, double, 2> arr2({100,10});
+    for (int i=0; i<20000; ++i)
+        arr2.add({dim0(generator), dim1(generator)}, (double)ival(generator));
+
+    for (auto policy : {DuplicatePolicy::ADD, DuplicatePolicy::LEAVE_ALONE, DuplicatePolicy::REPLACE}) {
+    for (auto sort_order : {std::array<int,2>{0,1}, std::array<int,2>{1,0}}) {
+        VectorCooArray<int, double, 2> serial(arr2.shape);
+        consolidate(serial, arr2, sort_order, policy);
+
+        for (int nthreads=2; nthreads<=5; ++nthreads) {
+            EXPECT_EQ(sorted_permutation(arr2, sort_order),
+                sorted_permutation(arr2, sort_order, nthreads));
+
+            VectorCooArray<int, double, 2> parallel(arr2.shape);
+            consolidate(parallel, arr2, sort_order, policy, false, nthreads);
+
+            EXPECT_EQ(sort_order, parallel.sort_order);
+            EXPECT_EQ(to_vector(serial.indices(0)), to_vector(parallel.indices(0)));
+            EXPECT_EQ(to_vector(serial.indices(1)), to_vector(parallel.indices(1)));
+            EXPECT_EQ(to_vector(serial.vals()), to_vector(parallel.vals()));
+        }
+    }}
+}
+
 TEST_F(SpSparseTest, dim_beginnings_iterators)
 {
     typedef VectorCooArray<int, double, 2> VectorCooArrayT;
@@ -237,6 +503,301 @@ TEST_F(SpSparseTest, dim_beginnings_iterators)
 }
 
 
+TEST_F(SpSparseTest, compressed_array)
+{
+    VectorCooMatrix<int, double> coo({20,10});
+    coo.add({6,4}, 10.);
+    coo.add({1,3}, 17.);
+    coo.add({2,4}, 17.);
+    coo.add({1,0}, 15.);
+    coo.add({1,3}, 1.);
+    auto dense(coo.to_dense());
+
+    // Build directly with consolidate()
+    CscArray<int, double> csc(coo.shape);
+    consolidate(csc, coo, {1,0});
+    EXPECT_EQ(4, csc.size());
+    EXPECT_EQ(3, csc.nmajor());
+    EXPECT_TRUE(all(dense == csc.to_dense()));
+
+    // Zero-copy conversion
+    coo.consolidate({0,1});
+    CsrArray<int, double> csr(std::move(coo));
+    EXPECT_EQ(0, coo.size());
+    EXPECT_EQ(4, csr.size());
+    EXPECT_EQ(3, csr.nmajor());
+    EXPECT_TRUE(all(dense == csr.to_dense()));
+
+    std::vector<size_t> db {0, 2, 3, 4};
+    EXPECT_EQ(db, csr.dim_beginnings());
+    std::vector<int> rows {1, 2, 6};
+    EXPECT_EQ(rows, csr.major_indices());
+    EXPECT_EQ(2, csr.index(0, 2));
+    EXPECT_EQ(4, csr.index(1, 2));
+    EXPECT_EQ(18., csr.val(1));
+
+    // Iterate by rows
+    auto dbi(csr.dim_beginnings_xiter());
+    EXPECT_EQ(1, *dbi);
+    auto ii1(dbi.sub_xiter());
+    EXPECT_EQ(0, *ii1);
+    EXPECT_EQ(15., ii1.val());
+    ++ii1;
+    EXPECT_EQ(3, *ii1);
+    EXPECT_EQ(18., ii1.val());
+    ++ii1;
+    EXPECT_TRUE(ii1.eof());
+    ++dbi;
+    EXPECT_EQ(2, *dbi);
+    ++dbi;
+    EXPECT_EQ(6, *dbi);
+    ++dbi;
+    EXPECT_TRUE(dbi.eof());
+
+    // Only sorted appends are allowed
+    CsrArray<int, double> csr2(csr.shape);
+    csr2.add({1,3}, 1.);
+    EXPECT_THROW(csr2.add({1,3}, 1.), spsparse::Exception);
+    EXPECT_THROW(csr2.add({0,5}, 1.), spsparse::Exception);
+    EXPECT_THROW(csr2.set_sorted({1,0}), spsparse::Exception);
+    csr2.add({1,5}, 1.);
+    csr2.add({3,0}, 1.);
+    EXPECT_EQ(3, csr2.size());
+    EXPECT_EQ(2, csr2.nmajor());
+}
+
+TEST_F(SpSparseTest, packed_compressed_array)
+{
+    // Varints of all lengths
+    std::vector<uint8_t> buf;
+    std::vector<uint64_t> vals {0, 1, 127, 128, 300, 16383, 16384, (uint64_t)1 << 40};
+    for (auto v : vals) varint_encode(buf, v);
+    uint8_t const *p = buf.data();
+    for (auto v : vals) EXPECT_EQ(v, varint_decode(p));
+    EXPECT_EQ(buf.data() + buf.size(), p);
+
+    VectorCooMatrix<long, double> coo({20,100000});
+    coo.add({6,4}, 10.);
+    coo.add({1,3}, 17.);
+    coo.add({2,4}, 17.);
+    coo.add({1,0}, 15.);
+    coo.add({1,99999}, 2.);
+    coo.add({1,3}, 1.);
+    auto dense(coo.to_dense());
+
+    PackedCsrArray<long, double> packed(coo);
+    EXPECT_EQ(5, packed.size());
+    EXPECT_EQ(3, packed.nmajor());
+    EXPECT_TRUE(all(dense == packed.to_dense()));
+    std::vector<size_t> db {0, 3, 4, 5};
+    EXPECT_EQ(db, packed.dim_beginnings());
+    EXPECT_EQ(99999, packed.index(1, 2));
+    EXPECT_EQ(1, packed.index(0, 2));
+    EXPECT_EQ(4, packed.index(1, 4));
+
+    // Same elements as the unpacked array, in the same order
+    CsrArray<long, double> csr(coo.shape);
+    consolidate(csr, coo, {0,1});
+    auto jj(csr.begin());
+    for (auto ii(packed.begin()); ii != packed.end(); ++ii, ++jj) {
+        EXPECT_EQ(jj.index(), ii.index());
+        EXPECT_EQ(jj.val(), ii.val());
+    }
+    EXPECT_TRUE(jj == csr.end());
+    EXPECT_LT(packed.packed_minor_indices().size(), csr.size() * sizeof(long));
+
+    // Iterate by rows
+    auto dbi(packed.dim_beginnings_xiter());
+    EXPECT_EQ(1, *dbi);
+    auto ii1(dbi.sub_xiter());
+    EXPECT_EQ(0, *ii1);
+    EXPECT_EQ(15., ii1.val());
+    ++ii1;
+    EXPECT_EQ(3, *ii1);
+    EXPECT_EQ(18., ii1.val());
+    ++ii1;
+    EXPECT_EQ(99999, *ii1);
+    ++ii1;
+    EXPECT_TRUE(ii1.eof());
+    dbi.skip_to(3);
+    EXPECT_EQ(6, *dbi);
+
+    // Join a row with a sorted vector
+    std::vector<long> cols {3, 4, 99999};
+    std::vector<long> joined;
+    auto dbi2(packed.dim_beginnings_xiter());
+    for (auto ii(join2_xiter(dbi2.sub_xiter(), make_xiter(cols.cbegin(), cols.cend())));
+        !ii.eof(); ++ii)
+    { joined.push_back(*ii.i1); }
+    EXPECT_EQ(std::vector<long>({3, 99999}), joined);
+
+    // Only sorted appends are allowed
+    PackedCscArray<long, double> csc2(coo.shape);
+    csc2.add({1,3}, 1.);
+    EXPECT_THROW(csc2.add({1,3}, 1.), spsparse::Exception);
+    EXPECT_THROW(csc2.add({0,3}, 1.), spsparse::Exception);
+    EXPECT_THROW(csc2.set_sorted({0,1}), spsparse::Exception);
+    csc2.add({5,3}, 1.);
+    csc2.add({0,7}, 1.);
+    EXPECT_EQ(3, csc2.size());
+    EXPECT_EQ(2, csc2.nmajor());
+}
+
+TEST_F(SpSparseTest, dense_scatter)
+{
+    std::default_random_engine generator(11);
+    std::uniform_int_distribution<int> i_distro(0, 29);
+    std::uniform_int_distribution<int> j_distro(0, 6);
+    std::uniform_int_distribution<int> k_distro(0, 4);
+    std::uniform_real_distribution<double> val_distro(0, 1);
+
+    VectorCooArray<int, double, 3> A({30,7,5});
+    for (int n=0; n<3000; ++n) A.add(
+        {i_distro(generator), j_distro(generator), k_distro(generator)},
+        val_distro(generator));
+
+    // Sorted by dimension 0, but with the duplicates still in
+    VectorCooArray<int, double, 3> As(A.shape);
+    std::vector<size_t> perm(sorted_permutation(A, {0,1,2}));
+    for (auto ii=perm.begin(); ii != perm.end(); ++ii) As.add(A.index(*ii), A.val(*ii));
+    As.set_sorted({0,1,2});
+
+    // Same as DenseAccum, bit for bit, for every policy and thread count
+    for (auto const *arr : {&A, &As}) {
+    for (auto policy : {DuplicatePolicy::ADD, DuplicatePolicy::REPLACE, DuplicatePolicy::LEAVE_ALONE}) {
+        blitz::Array<double,3> B1(30,7,5);
+        B1 = 1;
+        DenseAccum<VectorCooArray<int, double, 3>> accum(B1, policy);
+        copy(accum, *arr);
+
+        for (int nthreads : {1, 3}) {
+            blitz::Array<double,3> B2(30,7,5);
+            B2 = 1;
+            dense_scatter(B2, *arr, policy, nthreads);
+            EXPECT_TRUE(all(B1 == B2));
+        }
+    }}
+    EXPECT_TRUE(all(A.to_dense() == A.to_dense(0, 4)));
+
+    // Strided output
+    VectorCooVector<int, double> V({10});
+    V.add({3}, 1.);
+    V.add({9}, 2.);
+    V.add({3}, 4.);
+    blitz::Array<double,1> vv(20);
+    vv = 0;
+    blitz::Array<double,1> v(vv(blitz::Range(0, 19, 2)));
+    dense_scatter(v, V);
+    EXPECT_EQ(5., vv(6));
+    EXPECT_EQ(2., vv(18));
+    double sum = 0;
+    for (int i=0; i<20; ++i) sum += vv(i);
+    EXPECT_EQ(7., sum);
+
+    // Output too small
+    blitz::Array<double,1> small(9);
+    EXPECT_THROW(dense_scatter(small, V), spsparse::Exception);
+}
+
+TEST_F(SpSparseTest, mmap_array)
+{
+    std::string fname("__mmap_test.spsparse");
+    ::remove(fname.c_str());
+
+    VectorCooMatrix<int, double> coo({20,10});
+    coo.add({6,4}, 10.);
+    coo.add({1,3}, 17.);
+    coo.add({2,4}, 17.);
+    coo.add({1,0}, 15.);
+    coo.add({1,3}, 1.);
+    coo.consolidate({0,1});
+    MmapCooMatrix<int, double>::write(fname, coo);
+
+    {
+        MmapCooMatrix<int, double> A(fname);
+        EXPECT_TRUE(A.is_mapped());
+        EXPECT_EQ(coo.shape, A.shape);
+        EXPECT_EQ(coo.sort_order, A.sort_order);
+        EXPECT_EQ(coo.size(), A.size());
+        for (size_t i=0; i<coo.size(); ++i) {
+            EXPECT_EQ(coo.index(i), A.index(i));
+            EXPECT_EQ(coo.val(i), A.val(i));
+        }
+        EXPECT_EQ(coo.dim_beginnings(), A.dim_beginnings());
+        EXPECT_TRUE(all(coo.to_dense() == A.to_dense()));
+
+        // Iterate by rows
+        auto dbi(A.dim_beginnings_xiter());
+        EXPECT_EQ(1, *dbi);
+        auto ii1(dbi.sub_xiter());
+        EXPECT_EQ(0, *ii1);
+        EXPECT_EQ(15., ii1.val());
+        ++ii1;
+        EXPECT_EQ(3, *ii1);
+        EXPECT_EQ(18., ii1.val());
+
+        // Read-only
+        EXPECT_THROW(A.add({0,0}, 1.), spsparse::Exception);
+
+        // Consolidating in another order makes a heap copy
+        Consolidate<MmapCooMatrix<int, double>> Acm(&A, {1,0});
+        EXPECT_FALSE(Acm().is_mapped());
+        EXPECT_EQ((std::array<int,2>{1,0}), Acm().sort_order);
+        EXPECT_EQ(0, Acm().index(1,0));
+        EXPECT_TRUE(all(coo.to_dense() == Acm().to_dense()));
+
+        // Copies share the mapping, and outlive the original
+        MmapCooMatrix<int, double> A2(A);
+        A.clear();
+        EXPECT_EQ(0, A.size());
+        EXPECT_EQ(coo.size(), A2.size());
+        EXPECT_EQ(18., A2.val(1));
+    }
+
+    // Types must match the file
+    typedef MmapCooMatrix<long, double> LongMatrixT;
+    typedef MmapCooMatrix<int, float> FloatMatrixT;
+    typedef MmapCooVector<int, double> VectorT;
+    EXPECT_THROW(LongMatrixT Al(fname), spsparse::Exception);
+    EXPECT_THROW(FloatMatrixT Af(fname), spsparse::Exception);
+    EXPECT_THROW(VectorT Av(fname), spsparse::Exception);
+
+    ::remove(fname.c_str());
+}
+
+TEST_F(SpSparseTest, sorted_state)
+{
+    VectorCooMatrix<int, double> A({4,5});
+    A.add({2,1}, 1.);
+    A.add({0,3}, 2.);
+    A.add({2,0}, 3.);
+    A.add({0,4}, 4.);
+
+    EXPECT_FALSE(is_sorted_by(A, {0,1}));
+    A.consolidate({0,1});
+    EXPECT_TRUE(is_sorted_by(A, {0,1}));
+    EXPECT_FALSE(is_sorted_by(A, {1,0}));
+
+    // Duplicates are not consolidated
+    VectorCooMatrix<int, double> B(A);
+    B.edit();
+    B.add({2,1}, 1.);
+    B.set_sorted({0,1});
+    EXPECT_FALSE(is_sorted_by(B, {0,1}));
+
+    // Installing a precomputed dim_beginnings
+    std::vector<size_t> db(A.dim_beginnings());
+    EXPECT_EQ(std::vector<size_t>({0,2,4}), db);
+    VectorCooMatrix<int, double> C(A);
+    C.set_dim_beginnings(std::vector<size_t>(db));
+    EXPECT_EQ(db, C.dim_beginnings());
+
+    EXPECT_THROW(C.set_dim_beginnings({0,2,3}), spsparse::Exception);
+    EXPECT_THROW(C.set_dim_beginnings({0,2,2,4}), spsparse::Exception);
+    C.edit();
+    EXPECT_THROW(C.set_dim_beginnings({0,2,4}), spsparse::Exception);
+}
+
 TEST_F(SpSparseTest, dense)
 {
     typedef VectorCooArray<int, double, 2> VectorCooArrayT;
@@ -262,6 +823,111 @@ TEST_F(SpSparseTest, dense)
 }
 
 
+TEST_F(SpSparseTest, hash_accum)
+{
+    std::default_random_engine generator(3);
+    std::uniform_int_distribution<int> row_distro(0, 49);
+    std::uniform_int_distribution<int> col_distro(0, 29);
+    std::uniform_real_distribution<double> val_distro(-1, 1);
+
+    VectorCooMatrix<int, double> A({50,30});
+    for (int i=0; i<2000; ++i)
+        A.add({row_distro(generator), col_distro(generator)}, val_distro(generator));
+    A.add({4,4}, 0.);
+    A.add({5,5}, std::numeric_limits<double>::quiet_NaN());
+
+    // Same answer as consolidate(), for every duplicate policy
+    for (auto policy : {DuplicatePolicy::ADD, DuplicatePolicy::REPLACE, DuplicatePolicy::LEAVE_ALONE}) {
+        VectorCooMatrix<int, double> B(A.shape);
+        consolidate(B, A, {1,0}, policy, true);
+
+        HashAccum<VectorCooMatrix<int, double>> hash(A.shape, policy, true);
+        copy(hash, A);
+        EXPECT_EQ(B.size(), hash.size());
+
+        VectorCooMatrix<int, double> C(A.shape);
+        hash.emit_sorted(C, {1,0});
+        EXPECT_EQ(B.sort_order, C.sort_order);
+        ASSERT_EQ(B.size(), C.size());
+        for (size_t i=0; i<B.size(); ++i) {
+            EXPECT_EQ(B.index(i), C.index(i));
+            EXPECT_EQ(B.val(i), C.val(i));
+        }
+
+        // Unsorted: in order first seen
+        VectorCooMatrix<int, double> D(A.shape);
+        hash.emit(D);
+        EXPECT_EQ(A.index(0), D.index(0));
+        EXPECT_TRUE(all(B.to_dense() == D.to_dense()));
+    }
+
+    // Index too big to pack: falls back to hashing the tuple
+    std::array<size_t,3> big {(size_t)1<<40, (size_t)1<<40, 3};
+    HashAccum<VectorCooArray<long, double, 3>> hash3(big);
+    hash3.add({(long)1<<39, 17, 1}, 1.);
+    hash3.add({17, (long)1<<39, 1}, 2.);
+    hash3.add({(long)1<<39, 17, 1}, 4.);
+    EXPECT_EQ(2, hash3.size());
+    EXPECT_EQ(5., hash3.val(0));
+    EXPECT_EQ(2., hash3.val(1));
+    EXPECT_THROW(hash3.add({0, 0, 3}, 1.), spsparse::Exception);
+}
+
+TEST_F(SpSparseTest, concurrent_accum)
+{
+    std::default_random_engine generator(5);
+    std::uniform_int_distribution<int> row_distro(0, 39);
+    std::uniform_int_distribution<int> col_distro(0, 19);
+    std::uniform_real_distribution<double> val_distro(0, 1);
+
+    VectorCooMatrix<int, double> A({40,20});
+    for (int i=0; i<5000; ++i)
+        A.add({row_distro(generator), col_distro(generator)}, val_distro(generator));
+    auto Ad(A.to_dense());
+
+    int const nthreads = 4;
+    ConcurrentCooAccum<VectorCooMatrix<int, double>> cacc(nthreads);
+    blitz::Array<double,2> B(40,20);
+    B = 0;
+    ParallelDenseAccum<VectorCooMatrix<int, double>> Baccum(B, nthreads);
+    run_threads(nthreads, [&](int tid) {
+        auto &accum(cacc.local(tid));
+        auto &daccum(Baccum.local(tid));
+        for (size_t i=slice_begin(A.size(), nthreads, tid); i<slice_begin(A.size(), nthreads, tid+1); ++i) {
+            accum.add(A.index(i), A.val(i));
+            daccum.add(A.index(i), A.val(i));
+        }
+    });
+    EXPECT_EQ(A.size(), cacc.size());
+
+    // Each thread's slot starts its own cache line
+    for (int tid=0; tid<nthreads; ++tid) {
+        EXPECT_EQ(0, (uintptr_t)&cacc.local(tid) % 64);
+        EXPECT_EQ(0, (uintptr_t)&Baccum.local(tid) % 64);
+    }
+
+    // Same elements, in order of thread
+    VectorCooMatrix<int, double> C(A.shape);
+    cacc.finalize(C);
+    EXPECT_EQ(0, cacc.size());
+    ASSERT_EQ(A.size(), C.size());
+    for (size_t i=0; i<A.size(); ++i) {
+        EXPECT_EQ(A.index(i), C.index(i));
+        EXPECT_EQ(A.val(i), C.val(i));
+    }
+
+    Baccum.reduce();
+    for (int i=0; i<40; ++i) {
+    for (int j=0; j<20; ++j) {
+        EXPECT_NEAR(Ad(i,j), B(i,j), 1e-12);
+    }}
+
+    // Bounds are checked on finalize
+    ConcurrentCooAccum<VectorCooMatrix<int, double>> cacc2(2);
+    cacc2.local(1).add({40,0}, 1.);
+    EXPECT_THROW(cacc2.finalize(C), spsparse::Exception);
+}
+
 TEST_F(SpSparseTest, dense_to_blitz)
 {
     typedef VectorCooArray<int, double, 2> VectorCooArrayT;
@@ -23,7 +23,10 @@
 #include <gtest/gtest.h>
 #include <ibmisc/blitz.hpp>
 #include <spsparse/VectorCooArray.hpp>
+#include <spsparse/CompressedArray.hpp>
+#include <spsparse/PackedCompressedArray.hpp>
 #include <spsparse/multiply_sparse.hpp>
+#include <spsparse/multiply_dense.hpp>
 #include <spsparse/eigen.hpp>
 #ifdef USE_EVERYTRACE
 #include <everytrace.h>
@@ -156,6 +159,74 @@ TEST_F(SpSparseTest, random_MM_multiply)
         test_random_MM_multiply(5,seed);
 }
 // ---------------------------------------------------------
+void test_random_MM_multiply_scaled(unsigned int ni, unsigned int nj, unsigned int nk,
+    char transpose_A, char transpose_B, int seed, double density=1.0)
+{
+    std::default_random_engine generator(seed);
+    auto val_distro(std::bind(std::uniform_real_distribution<double>(0,1), generator));
+
+    std::array<size_t,2> ashape(transpose_A == 'T'
+        ? std::array<size_t,2>{nj,ni} : std::array<size_t,2>{ni,nj});
+    std::array<size_t,2> bshape(transpose_B == 'T'
+        ? std::array<size_t,2>{nk,nj} : std::array<size_t,2>{nj,nk});
+    VectorCooMatrix<int, double> A(ashape);
+    VectorCooMatrix<int, double> B(bshape);
+    int nranda = (int)(val_distro() * (double)(ni*nj));
+    for (int i=0; i<nranda; ++i) A.add({
+        (int)(val_distro()*ashape[0]), (int)(val_distro()*ashape[1])}, val_distro());
+    int nrandb = (int)(density * val_distro() * (double)(nj*nk));
+    for (int i=0; i<nrandb; ++i) B.add({
+        (int)(val_distro()*bshape[0]), (int)(val_distro()*bshape[1])}, val_distro());
+
+    // Scale vectors, with some elements missing
+    VectorCooVector<int, double> scalei({ni}), scalej({nj}), scalek({nk});
+    for (int i=0; i<ni; ++i) if (val_distro() < .8) scalei.add({i}, val_distro());
+    for (int j=0; j<nj; ++j) if (val_distro() < .8) scalej.add({j}, val_distro());
+    for (int k=0; k<nk; ++k) if (val_distro() < .8) scalek.add({k}, val_distro());
+
+    VectorCooMatrix<int, double> C;
+    multiply(C, 2.0,
+        &scalei, A, transpose_A, &scalej, B, transpose_B, &scalek);
+
+    // --------- Compare to dense matrix multiplication
+    auto Ad(A.to_dense());
+    auto Bd(B.to_dense());
+    auto Cd(C.to_dense());
+    auto sid(scalei.to_dense());
+    auto sjd(scalej.to_dense());
+    auto skd(scalek.to_dense());
+
+    EXPECT_EQ(ni, C.shape[0]);
+    EXPECT_EQ(nk, C.shape[1]);
+    for (int i=0; i<ni; ++i) {
+    for (int k=0; k<nk; ++k) {
+        double sum=0;
+        for (int j=0; j<nj; ++j) {
+            double const a = (transpose_A == 'T' ? Ad(j,i) : Ad(i,j));
+            double const b = (transpose_B == 'T' ? Bd(k,j) : Bd(j,k));
+            sum += a * sjd(j) * b;
+        }
+        EXPECT_DOUBLE_EQ(sum * 2.0 * sid(i) * skd(k), Cd(i,k));
+    }}
+}
+
+TEST_F(SpSparseTest, random_MM_multiply_scaled)
+{
+    for (int seed=1; seed<200; ++seed) {
+        test_random_MM_multiply_scaled(4,7,5, '.','.', seed);
+        test_random_MM_multiply_scaled(4,7,5, 'T','.', seed);
+        test_random_MM_multiply_scaled(4,7,5, '.','T', seed);
+        test_random_MM_multiply_scaled(4,7,5, 'T','T', seed);
+    }
+
+    // Wide, very sparse output: uses the hashed SPA
+    for (int seed=1; seed<5; ++seed)
+        test_random_MM_multiply_scaled(3,4,20000, '.','T', seed, .001);
+    // ...with rows long enough to grow the hash table
+    for (int seed=1; seed<3; ++seed)
+        test_random_MM_multiply_scaled(5,100,50000, '.','.', seed, .0001);
+}
+// ---------------------------------------------------------
 void test_random_MV_multiply(unsigned int dsize, int seed)
 {
     std::default_random_engine generator(seed);
@@ -180,6 +251,29 @@ void test_random_MV_multiply(unsigned int dsize, int seed)
         (VectorCooVector<int, double> *)0,  // scalej
         B);
 
+    // Same thing, with A stored as CSR
+    CsrArray<int, double> Acsr(A.shape);
+    consolidate(Acsr, A, {0,1});
+    VectorCooVector<int, double> C2;
+    multiply(C2,1.0,
+        (VectorCooVector<int, double> *)0,  // scalei
+        Acsr, '.',
+        (VectorCooVector<int, double> *)0,  // scalej
+        B);
+    EXPECT_EQ(C.size(), C2.size());
+    EXPECT_TRUE(all(C.to_dense() == C2.to_dense()));
+
+    // ...and packed
+    PackedCsrArray<int, double> Apacked(A);
+    VectorCooVector<int, double> C3;
+    multiply(C3,1.0,
+        (VectorCooVector<int, double> *)0,  // scalei
+        Apacked, '.',
+        (VectorCooVector<int, double> *)0,  // scalej
+        B);
+    EXPECT_EQ(C.size(), C3.size());
+    EXPECT_TRUE(all(C.to_dense() == C3.to_dense()));
+
     // --------- Compare to dense matrix multiplication
     auto Ad(A.to_dense());
     auto Bd(B.to_dense());
@@ -212,6 +306,397 @@ TEST_F(SpSparseTest, random_MV_multiply)
         test_random_MV_multiply(5,seed);
     }
 }
+// ---------------------------------------------------------
+void test_random_MV_multiply_threaded(unsigned int ni, unsigned int nj, char transpose_A, int seed)
+{
+    std::default_random_engine generator(seed);
+    auto val_distro(std::bind(std::uniform_real_distribution<double>(0,1), generator));
+
+    std::array<size_t,2> ashape(transpose_A == 'T'
+        ? std::array<size_t,2>{nj,ni} : std::array<size_t,2>{ni,nj});
+    VectorCooMatrix<int, double> A(ashape);
+    VectorCooVector<int, double> V({nj});
+    int nranda = (int)(.2 * val_distro() * (double)(ni*nj));
+    for (int i=0; i<nranda; ++i) A.add({
+        (int)(val_distro()*ashape[0]), (int)(val_distro()*ashape[1])}, val_distro());
+    int nrandv = (int)(val_distro() * (double)nj);
+    for (int i=0; i<nrandv; ++i) V.add({(int)(val_distro()*nj)}, val_distro());
+
+    VectorCooVector<int, double> scalei({ni}), scalej({nj});
+    for (int i=0; i<ni; ++i) if (val_distro() < .8) scalei.add({i}, val_distro());
+    for (int j=0; j<nj; ++j) if (val_distro() < .8) scalej.add({j}, val_distro());
+
+    VectorCooVector<int, double> C1;
+    multiply(C1, 3.0, &scalei, A, transpose_A, &scalej, V);
+
+    for (int nthreads=2; nthreads<=5; ++nthreads) {
+        VectorCooVector<int, double> Cn;
+        multiply(Cn, 3.0, &scalei, A, transpose_A, &scalej, V,
+            DuplicatePolicy::ADD, false, nthreads);
+        EXPECT_EQ(to_vector(C1.indices(0)), to_vector(Cn.indices(0)));
+        EXPECT_EQ(to_vector(C1.vals()), to_vector(Cn.vals()));
+
+        // Without scaling
+        VectorCooVector<int, double> D1, Dn;
+        multiply(D1, 1.0, (VectorCooVector<int, double> *)0, A, transpose_A,
+            (VectorCooVector<int, double> *)0, V);
+        multiply(Dn, 1.0, (VectorCooVector<int, double> *)0, A, transpose_A,
+            (VectorCooVector<int, double> *)0, V,
+            DuplicatePolicy::ADD, false, nthreads);
+        EXPECT_EQ(to_vector(D1.indices(0)), to_vector(Dn.indices(0)));
+        EXPECT_EQ(to_vector(D1.vals()), to_vector(Dn.vals()));
+    }
+}
+
+TEST_F(SpSparseTest, random_MV_multiply_threaded)
+{
+    for (int seed=1; seed<20; ++seed) {
+        test_random_MV_multiply_threaded(50, 40, '.', seed);
+        test_random_MV_multiply_threaded(50, 40, 'T', seed);
+    }
+}
+// ---------------------------------------------------------
+void test_random_multiply_batch(unsigned int ni, unsigned int nj, unsigned int nfield, char transpose_A, int seed)
+{
+    std::default_random_engine generator(seed);
+    auto val_distro(std::bind(std::uniform_real_distribution<double>(0,1), generator));
+
+    std::array<size_t,2> ashape(transpose_A == 'T'
+        ? std::array<size_t,2>{nj,ni} : std::array<size_t,2>{ni,nj});
+    VectorCooMatrix<int, double> A(ashape);
+    int nranda = (int)(.3 * val_distro() * (double)(ni*nj));
+    for (int i=0; i<nranda; ++i) A.add({
+        (int)(val_distro()*ashape[0]), (int)(val_distro()*ashape[1])}, val_distro());
+
+    VectorCooVector<int, double> scalei({ni}), scalej({nj});
+    for (int i=0; i<ni; ++i) if (val_distro() < .8) scalei.add({i}, val_distro());
+    for (int j=0; j<nj; ++j) if (val_distro() < .8) scalej.add({j}, val_distro());
+
+    // ------- Sparse right-hand sides
+    std::vector<VectorCooVector<int, double>> Vs, rets;
+    for (int f=0; f<nfield; ++f) {
+        Vs.push_back(VectorCooVector<int, double>({nj}));
+        rets.push_back(VectorCooVector<int, double>());
+        int nrandv = (int)(val_distro() * (double)nj);
+        for (int i=0; i<nrandv; ++i) Vs[f].add({(int)(val_distro()*nj)}, val_distro());
+    }
+    std::vector<VectorCooVector<int, double> const *> pVs;
+    std::vector<VectorCooVector<int, double> *> prets;
+    for (int f=0; f<nfield; ++f) {
+        pVs.push_back(&Vs[f]);
+        prets.push_back(&rets[f]);
+    }
+    multiply_batch(prets, 3.0, &scalei, A, transpose_A, &scalej, pVs);
+
+    for (int f=0; f<nfield; ++f) {
+        VectorCooVector<int, double> C1;
+        multiply(C1, 3.0, &scalei, A, transpose_A, &scalej, Vs[f]);
+        EXPECT_EQ(to_vector(C1.indices(0)), to_vector(rets[f].indices(0)));
+        EXPECT_EQ(to_vector(C1.vals()), to_vector(rets[f].vals()));
+    }
+
+    // ------- Dense right-hand sides
+    blitz::Array<double,2> X(nfield, nj);
+    blitz::Array<double,2> Y(nfield, ni);
+    Y = 0;
+    for (int f=0; f<nfield; ++f)
+    for (int j=0; j<nj; ++j) X(f,j) = val_distro();
+    multiply_batch(Y, 3.0, &scalei, A, transpose_A, &scalej, X);
+
+    for (int f=0; f<nfield; ++f) {
+        VectorCooVector<int, double> V({nj});
+        for (int j=0; j<nj; ++j) V.add({j}, X(f,j));
+        VectorCooVector<int, double> C1({ni});
+        multiply(C1, 3.0, &scalei, A, transpose_A, &scalej, V);
+        auto C1d(C1.to_dense());
+        for (int i=0; i<ni; ++i) EXPECT_DOUBLE_EQ(C1d(i), Y(f,i));
+    }
+}
+
+TEST_F(SpSparseTest, random_multiply_batch)
+{
+    for (int seed=1; seed<20; ++seed) {
+        test_random_multiply_batch(30, 40, 7, '.', seed);
+        test_random_multiply_batch(30, 40, 7, 'T', seed);
+    }
+}
+// ---------------------------------------------------------
+template<class IndexT>
+void test_random_multiply_dense(unsigned int ni, unsigned int nj, bool transpose, int seed)
+{
+    std::default_random_engine generator(seed);
+    auto val_distro(std::bind(std::uniform_real_distribution<double>(0,1), generator));
+
+    std::array<size_t,2> ashape(transpose
+        ? std::array<size_t,2>{nj,ni} : std::array<size_t,2>{ni,nj});
+    VectorCooMatrix<IndexT, double> A(ashape);
+    int nranda = (int)(.5 * val_distro() * (double)(ni*nj));
+    for (int i=0; i<nranda; ++i) A.add({
+        (IndexT)(val_distro()*ashape[0]), (IndexT)(val_distro()*ashape[1])}, val_distro());
+
+    // Every other element of a bigger array: non-unit stride
+    blitz::Array<double,1> xx(2*nj);
+    for (int j=0; j<2*nj; ++j) xx(j) = val_distro();
+    blitz::Array<double,1> x(xx(blitz::Range(0, 2*nj-1, 2)));
+    blitz::Array<double,1> xc(nj);
+    for (int j=0; j<nj; ++j) xc(j) = x(j);
+
+    VectorCooVector<IndexT, double> V({nj});
+    for (int j=0; j<nj; ++j) V.add({j}, x(j));
+    VectorCooVector<IndexT, double> y1;
+    multiply(y1, 1.0, (VectorCooVector<IndexT, double> *)0,
+        A, transpose ? 'T' : '.', (VectorCooVector<IndexT, double> *)0, V);
+    auto y1d(y1.to_dense());
+
+    for (int k=0; k<2; ++k) {
+        blitz::Array<double,1> yd(ni);
+        yd = 0;
+        DenseAccum<VectorCooVector<IndexT, double>> yaccum(yd);
+        multiply(yaccum, A, (k == 0 ? x : xc), false, transpose);
+        for (int i=0; i<ni; ++i) EXPECT_NEAR(y1d(i), yd(i), 1e-12);
+    }
+
+    // Packed matrices: dot products (CSR) or scatter (CSC)
+    PackedCsrArray<IndexT, double> Acsr(A);
+    PackedCscArray<IndexT, double> Acsc(A);
+    for (int k=0; k<2; ++k) {
+        blitz::Array<double,1> yd(ni);
+        yd = 0;
+        DenseAccum<VectorCooVector<IndexT, double>> yaccum(yd);
+        if (k == 0) multiply(yaccum, Acsr, x, false, transpose);
+        else multiply(yaccum, Acsc, x, false, transpose);
+        for (int i=0; i<ni; ++i) EXPECT_NEAR(y1d(i), yd(i), 1e-12);
+    }
+
+    // handle_nan drops non-finite products
+    xc(nj/2) = std::numeric_limits<double>::quiet_NaN();
+    xc(nj/3) = std::numeric_limits<double>::infinity();
+    V.clear();
+    for (int j=0; j<nj; ++j) if (std::isfinite(xc(j))) V.add({j}, xc(j));
+    VectorCooVector<IndexT, double> y2;
+    multiply(y2, 1.0, (VectorCooVector<IndexT, double> *)0,
+        A, transpose ? 'T' : '.', (VectorCooVector<IndexT, double> *)0, V);
+    auto y2d(y2.to_dense());
+
+    blitz::Array<double,1> yd(ni);
+    yd = 0;
+    DenseAccum<VectorCooVector<IndexT, double>> yaccum(yd);
+    multiply(yaccum, A, xc, true, transpose);
+    for (int i=0; i<ni; ++i) EXPECT_NEAR(y2d(i), yd(i), 1e-12);
+}
+
+TEST_F(SpSparseTest, random_multiply_dense)
+{
+    for (int seed=1; seed<20; ++seed) {
+        test_random_multiply_dense<int>(30, 40, false, seed);
+        test_random_multiply_dense<int>(30, 40, true, seed);
+        test_random_multiply_dense<long>(30, 40, false, seed);
+    }
+}
+// ---------------------------------------------------------
+/** Fixed-order arrays (CSR, CSC, packed), used either way round, must
+give the same products as the VectorCooMatrix they were made from. */
+template<class MatT>
+void test_fixed_order_multiply(
+    VectorCooMatrix<int, double> const &A,
+    MatT const &Ax,
+    VectorCooMatrix<int, double> const &B,
+    VectorCooVector<int, double> const &V)
+{
+    int const n = A.shape[0];
+    blitz::Array<double,1> x(n);
+    for (int j=0; j<n; ++j) x(j) = 1.0 / (j+1);
+
+    for (char t : {'.', 'T'}) {
+        // Sparse matrix-vector
+        VectorCooVector<int, double> y1, y2;
+        multiply(y1, 1.0, (VectorCooVector<int, double> *)0,
+            A, t, (VectorCooVector<int, double> *)0, V);
+        multiply(y2, 1.0, (VectorCooVector<int, double> *)0,
+            Ax, t, (VectorCooVector<int, double> *)0, V);
+        auto y1d(y1.to_dense());
+        auto y2d(y2.to_dense());
+        for (int i=0; i<n; ++i) EXPECT_NEAR(y1d(i), y2d(i), 1e-12);
+
+        // Sparse matrix-matrix, as A and as B
+        VectorCooMatrix<int, double> C1, C2, C3, C4;
+        multiply(C1, 1.0, (VectorCooVector<int, double> *)0,
+            A, t, (VectorCooVector<int, double> *)0, B, '.', (VectorCooVector<int, double> *)0);
+        multiply(C2, 1.0, (VectorCooVector<int, double> *)0,
+            Ax, t, (VectorCooVector<int, double> *)0, B, '.', (VectorCooVector<int, double> *)0);
+        multiply(C3, 1.0, (VectorCooVector<int, double> *)0,
+            B, '.', (VectorCooVector<int, double> *)0, A, t, (VectorCooVector<int, double> *)0);
+        multiply(C4, 1.0, (VectorCooVector<int, double> *)0,
+            B, '.', (VectorCooVector<int, double> *)0, Ax, t, (VectorCooVector<int, double> *)0);
+        auto C1d(C1.to_dense());
+        auto C2d(C2.to_dense());
+        auto C3d(C3.to_dense());
+        auto C4d(C4.to_dense());
+        for (int i=0; i<n; ++i) {
+        for (int k=0; k<n; ++k) {
+            EXPECT_NEAR(C1d(i,k), C2d(i,k), 1e-12);
+            EXPECT_NEAR(C3d(i,k), C4d(i,k), 1e-12);
+        }}
+
+        // Dense vector
+        blitz::Array<double,1> yd1(n), yd2(n);
+        yd1 = 0;
+        yd2 = 0;
+        DenseAccum<VectorCooVector<int, double>> yaccum1(yd1);
+        DenseAccum<VectorCooVector<int, double>> yaccum2(yd2);
+        multiply(yaccum1, A, x, false, t == 'T');
+        multiply(yaccum2, Ax, x, false, t == 'T');
+        for (int i=0; i<n; ++i) EXPECT_NEAR(yd1(i), yd2(i), 1e-12);
+    }
+}
+
+TEST_F(SpSparseTest, fixed_order_multiply)
+{
+    std::default_random_engine generator(17);
+    std::uniform_int_distribution<int> dim_distro(0, 29);
+    std::uniform_real_distribution<double> val_distro(0,1);
+
+    VectorCooMatrix<int, double> A({30,30}), B({30,30});
+    VectorCooVector<int, double> V({30});
+    for (int i=0; i<200; ++i) {
+        A.add({dim_distro(generator), dim_distro(generator)}, val_distro(generator));
+        B.add({dim_distro(generator), dim_distro(generator)}, val_distro(generator));
+    }
+    for (int j=0; j<30; j += 2) V.add({j}, val_distro(generator));
+
+    CsrArray<int, double> Acsr(A.shape);
+    consolidate(Acsr, A, {0,1});
+    CscArray<int, double> Acsc(A.shape);
+    consolidate(Acsc, A, {1,0});
+
+    test_fixed_order_multiply(A, Acsr, B, V);
+    test_fixed_order_multiply(A, Acsc, B, V);
+    test_fixed_order_multiply(A, PackedCsrArray<int, double>(A), B, V);
+    test_fixed_order_multiply(A, PackedCscArray<int, double>(A), B, V);
+
+    // Packing from the other fixed order
+    PackedCscArray<int, double> Apcsc(Acsr);
+    EXPECT_TRUE(all(A.to_dense() == Apcsc.to_dense()));
+}
+
+#ifdef SPSPARSE_SIMD_KERNELS
+/** Runs the AVX2 / AVX-512 kernels that this CPU supports against the
+scalar kernel, whatever the build's -march. */
+template<class IndexT, class ValT>
+void test_sparse_dot_simd(int seed)
+{
+    std::default_random_engine generator(seed);
+    std::uniform_int_distribution<int> col_distro(0, 99);
+    std::uniform_real_distribution<double> val_distro(-1,1);
+
+    std::vector<double> x(100);
+    for (auto &xj : x) xj = val_distro(generator);
+    x[17] = std::numeric_limits<double>::quiet_NaN();
+    x[41] = std::numeric_limits<double>::infinity();
+
+    // Lengths cover the vector loop and the scalar remainder
+    for (size_t n : {0, 3, 4, 8, 13, 37}) {
+        std::vector<IndexT> cols(n);
+        std::vector<ValT> vals(n);
+        for (size_t k=0; k<n; ++k) {
+            cols[k] = col_distro(generator);
+            vals[k] = val_distro(generator);
+        }
+
+        double const expected = sparse_dot_scalar(&cols[0], &vals[0], n, &x[0], true);
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            EXPECT_NEAR(expected, sparse_dot_avx2(&cols[0], &vals[0], n, &x[0], true), 1e-12);
+        }
+        if (__builtin_cpu_supports("avx512f")) {
+            EXPECT_NEAR(expected, sparse_dot_avx512(&cols[0], &vals[0], n, &x[0], true), 1e-12);
+        }
+
+        // Without handle_nan, finite inputs only
+        for (auto &c : cols) if (c == 17 || c == 41) c = 0;
+        double const expected2 = sparse_dot_scalar(&cols[0], &vals[0], n, &x[0], false);
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            EXPECT_NEAR(expected2, sparse_dot_avx2(&cols[0], &vals[0], n, &x[0], false), 1e-12);
+        }
+        if (__builtin_cpu_supports("avx512f")) {
+            EXPECT_NEAR(expected2, sparse_dot_avx512(&cols[0], &vals[0], n, &x[0], false), 1e-12);
+        }
+    }
+}
+
+TEST_F(SpSparseTest, sparse_dot_simd)
+{
+    for (int seed=1; seed<20; ++seed) {
+        test_sparse_dot_simd<int32_t, double>(seed);
+        test_sparse_dot_simd<int64_t, double>(seed);
+        test_sparse_dot_simd<int32_t, float>(seed);
+        test_sparse_dot_simd<int64_t, float>(seed);
+    }
+}
+#endif
+// ---------------------------------------------------------
+TEST_F(SpSparseTest, mixed_precision)
+{
+    std::default_random_engine generator(17);
+    auto val_distro(std::bind(std::uniform_real_distribution<double>(0,1), generator));
+    const unsigned int ni = 50, nj = 70;
+
+    VectorCooMatrix<long, double> A({ni,nj});
+    for (int i=0; i<ni*nj/4; ++i) A.add({
+        (long)(val_distro()*ni), (long)(val_distro()*nj)}, val_distro());
+    A.consolidate({0,1});
+
+    // Store as int32 indices / float values; sort order carries over
+    VectorCooMatrix<int, float> Af;
+    convert(Af, A);
+    EXPECT_EQ(A.shape, Af.shape);
+    EXPECT_EQ(A.size(), Af.size());
+    EXPECT_EQ(A.sort_order, Af.sort_order);
+
+    // Appending to a non-empty array leaves it unsorted
+    VectorCooMatrix<int, float> Af2({ni,nj});
+    Af2.add({ni-1, nj-1}, 1.0f);
+    convert(Af2, A);
+    EXPECT_EQ(A.size()+1, Af2.size());
+    EXPECT_EQ(-1, Af2.sort_order[0]);
+
+    double const rel_err = max_relative_error<float>(A);
+    EXPECT_GT(rel_err, 0);
+    EXPECT_LT(rel_err, 1e-7);
+
+    blitz::Array<double,1> x(nj);
+    for (int j=0; j<nj; ++j) x(j) = val_distro();
+
+    // Accumulate in double either way: results agree to float precision
+    blitz::Array<double,1> y(ni), yf(ni);
+    y = 0;
+    yf = 0;
+    DenseAccum<VectorCooVector<long, double>> yaccum(y);
+    multiply(yaccum, A, x, false, false);
+    DenseAccum<VectorCooVector<int, double>> yfaccum(yf);
+    multiply(yfaccum, Af, x, false, false);
+    for (int i=0; i<ni; ++i) EXPECT_NEAR(y(i), yf(i), 1e-6 * std::abs(y(i)));
+
+    // Sparse-sparse, double output
+    VectorCooVector<long, double> V({nj});
+    for (int j=0; j<nj; ++j) V.add({j}, x(j));
+    VectorCooVector<long, double> y1;
+    multiply(y1, 1.0, (VectorCooVector<long, double> *)0,
+        A, '.', (VectorCooVector<long, double> *)0, V);
+    VectorCooVector<int, double> V2;
+    convert(V2, V);
+    VectorCooVector<int, double> y2;
+    multiply(y2, 1.0, (VectorCooVector<int, float> *)0,
+        Af, '.', (VectorCooVector<int, float> *)0, V2);
+    auto y1d(y1.to_dense());
+    auto y2d(y2.to_dense());
+    for (int i=0; i<ni; ++i) EXPECT_NEAR(y1d(i), y2d(i), 1e-6 * std::abs(y1d(i)));
+
+    // Index type too narrow for the shape
+    VectorCooMatrix<long, double> B({100000,3});
+    B.add({99999,0}, 1.0);
+    VectorCooMatrix<int16_t, float> Bs;
+    EXPECT_THROW(convert(Bs, B), spsparse::Exception);
+}
 // -----------------------------------------------------------
 void test_random_VV_multiply(unsigned int dsize, int seed)
 {
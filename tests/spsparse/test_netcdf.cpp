@@ -20,6 +20,7 @@
 
 #include <gtest/gtest.h>
 #include <spsparse/VectorCooArray.hpp>
+#include <spsparse/accum.hpp>
 #include <iostream>
 #ifdef USE_EVERYTRACE
 #include <everytrace.h>
@@ -116,6 +117,207 @@ TEST_F(SpSparseTest, NetCDF) {
 }
 
 
+TEST_F(SpSparseTest, NetCDFChunked) {
+    typedef VectorCooArray<int, double, 2> ArrayT;
+    EXPECT_TRUE(has_add_bulk<ArrayT>::value);
+    EXPECT_FALSE(has_add_bulk<HashAccum<ArrayT>>::value);
+
+    // Distinct indices; more than fit in one chunk, and not a multiple of it
+    ArrayT arr1({40,50});
+    for (int i=0; i<197; ++i)
+        arr1.add({(i*7) % 40, (i*13) % 50}, (double)(i+1));
+
+    std::string fname("__netcdf_chunked_test.nc");
+    tmpfiles.push_back(fname);
+    ::remove(fname.c_str());
+
+    // Write in chunks of 7
+    {
+        ibmisc::NcIO ncio(fname, NcFile::replace);
+        ncio_spsparse(ncio, arr1, true, "arr1", 7);
+        ncio.close();
+    }
+
+    // Read in chunks of 13 via VectorCooArray::add_bulk()
+    ArrayT arr2;
+    {
+        ibmisc::NcIO ncio(fname, NcFile::read);
+        ncio_spsparse(ncio, arr2, true, "arr1", 13);
+        ncio.close();
+    }
+
+    // Read in chunks of 5 via add(), into an accumulator without add_bulk()
+    HashAccum<ArrayT> hash(arr1.shape);
+    {
+        NcFile nc(fname, NcFile::read);
+        nc_read_spsparse(&nc, &hash, "arr1", 5);
+        nc.close();
+    }
+
+    ASSERT_EQ(arr1.size(), arr2.size());
+    ASSERT_EQ(arr1.size(), hash.size());
+    for (size_t i=0; i<arr1.size(); ++i) {
+        EXPECT_EQ(arr1.index(i), arr2.index(i));
+        EXPECT_EQ(arr1.val(i), arr2.val(i));
+
+        EXPECT_EQ(arr1.index(i), hash.index(i));
+        EXPECT_EQ(arr1.val(i), hash.val(i));
+    }
+}
+
+TEST_F(SpSparseTest, NetCDFColumnar) {
+    typedef VectorCooArray<int, double, 2> ArrayT;
+
+    // dim 0 fits in a byte, dim 1 needs a short
+    ArrayT arr1({100,1000});
+    for (int i=0; i<197; ++i)
+        arr1.add({(i*7) % 100, (i*13) % 1000}, (double)(i+1));
+    arr1.consolidate({0,1});
+
+    std::string fname("__netcdf_columnar_test.nc");
+    tmpfiles.push_back(fname);
+    ::remove(fname.c_str());
+
+    // Write
+    {
+        ibmisc::NcIO ncio(fname, NcFile::replace);
+        NcSparseOptions opts;
+        opts.columnar = true;
+        opts.storage_chunk = 64;
+        opts.deflate_level = 4;
+        opts.shuffle = true;
+        opts.chunk_size = 10;
+        ncio_spsparse(ncio, arr1, true, "arr1", opts);
+        ncio.close();
+    }
+
+    // Check what went on disk
+    {
+        NcFile nc(fname, NcFile::read);
+        EXPECT_TRUE(nc.getVar("arr1.indices").isNull());
+        EXPECT_EQ("byte", nc.getVar("arr1.index0").getType().getName());
+        EXPECT_EQ("short", nc.getVar("arr1.index1").getType().getName());
+
+        std::vector<size_t> chunks;
+        NcVar::ChunkMode mode;
+        nc.getVar("arr1.vals").getChunkingParameters(mode, chunks);
+        EXPECT_EQ(NcVar::nc_CHUNKED, mode);
+        EXPECT_EQ(std::vector<size_t>({64}), chunks);
+        nc.close();
+    }
+
+    // Read: the layout and sort order come from the file
+    ArrayT arr2;
+    {
+        ibmisc::NcIO ncio(fname, NcFile::read);
+        ncio_spsparse(ncio, arr2, true, "arr1", 13);
+        ncio.close();
+    }
+
+    EXPECT_EQ(arr1.sort_order, arr2.sort_order);
+    EXPECT_FALSE(arr2.edit_mode);
+    ASSERT_EQ(arr1.size(), arr2.size());
+    for (size_t i=0; i<arr1.size(); ++i) {
+        EXPECT_EQ(arr1.index(i), arr2.index(i));
+        EXPECT_EQ(arr1.val(i), arr2.val(i));
+    }
+
+    EXPECT_EQ("byte", nc_index_type(128));
+    EXPECT_EQ("short", nc_index_type(129));
+    EXPECT_EQ("int", nc_index_type(32769));
+    EXPECT_EQ("int64", nc_index_type((size_t)1 << 32));
+}
+
+TEST_F(SpSparseTest, NetCDFSortedState) {
+    typedef VectorCooArray<int, double, 2> ArrayT;
+
+    ArrayT arr1({40,50});
+    for (int i=0; i<197; ++i)
+        arr1.add({(i*7) % 40, (i*13) % 50}, (double)(i+1));
+    arr1.consolidate({1,0});
+
+    std::string fname("__netcdf_sorted_test.nc");
+    tmpfiles.push_back(fname);
+    ::remove(fname.c_str());
+
+    for (bool columnar : {false, true}) {
+        // Write the sort order and row pointers
+        {
+            ibmisc::NcIO ncio(fname, NcFile::replace);
+            NcSparseOptions opts;
+            opts.columnar = columnar;
+            opts.dim_beginnings = true;
+            ncio_spsparse(ncio, arr1, true, "arr1", opts);
+            ncio.close();
+        }
+
+        ArrayT arr2;
+        {
+            ibmisc::NcIO ncio(fname, NcFile::read);
+            ncio_spsparse(ncio, arr2, true, "arr1");
+            ncio.close();
+        }
+        EXPECT_EQ(arr1.sort_order, arr2.sort_order);
+        EXPECT_FALSE(arr2.edit_mode);
+        EXPECT_EQ(arr1.dim_beginnings(), arr2.dim_beginnings());
+    }
+
+    // Move one row boundary: still a valid dim_beginnings, but wrong.
+    // It is installed as stored (not recomputed) unless checked.
+    std::vector<size_t> bad_db(arr1.dim_beginnings());
+    {
+        size_t j=1;
+        while (bad_db[j]+1 == bad_db[j+1]) ++j;
+        ++bad_db[j];
+
+        NcFile nc(fname, NcFile::write);
+        std::vector<int64_t> db64(bad_db.begin(), bad_db.end());
+        nc.getVar("arr1.dim_beginnings").putVar({0}, {db64.size()}, &db64[0]);
+        nc.close();
+    }
+    {
+        ArrayT arr_checked, arr_trusted;
+        ibmisc::NcIO ncio(fname, NcFile::read);
+        ncio_spsparse(ncio, arr_checked, true, "arr1", NcSparseOptions());
+        NcSparseOptions opts;
+        opts.check_sorted = false;
+        ncio_spsparse(ncio, arr_trusted, true, "arr1", opts);
+        ncio.close();
+
+        EXPECT_TRUE(arr_checked.edit_mode);
+        EXPECT_EQ(-1, arr_checked.sort_order[0]);
+        EXPECT_FALSE(arr_trusted.edit_mode);
+        EXPECT_EQ(bad_db, arr_trusted.dim_beginnings());
+    }
+
+    // Corrupt the file: swap the first two elements
+    {
+        NcFile nc(fname, NcFile::write);
+        for (std::string vname : {"arr1.index0", "arr1.index1"}) {
+            NcVar v = nc.getVar(vname);
+            std::vector<int> idx(2);
+            v.getVar({0}, {2}, &idx[0]);
+            std::swap(idx[0], idx[1]);
+            v.putVar({0}, {2}, &idx[0]);
+        }
+        nc.close();
+    }
+
+    // The check catches it; without the check, the attribute is trusted
+    ArrayT arr3, arr4;
+    {
+        ibmisc::NcIO ncio(fname, NcFile::read);
+        ncio_spsparse(ncio, arr3, true, "arr1", NcSparseOptions());
+        NcSparseOptions opts;
+        opts.check_sorted = false;
+        ncio_spsparse(ncio, arr4, true, "arr1", opts);
+        ncio.close();
+    }
+    EXPECT_TRUE(arr3.edit_mode);
+    EXPECT_EQ(-1, arr3.sort_order[0]);
+    EXPECT_FALSE(arr4.edit_mode);
+}
+
 int main(int argc, char **argv) {
 #ifdef USE_EVERYTRACE
     everytrace_init();
@@ -19,8 +19,12 @@
 // https://github.com/google/googletest/blob/master/googletest/docs/Primer.md
 
 #include <gtest/gtest.h>
+#include <spsparse/VectorCooArray.hpp>
 #include <spsparse/xiter.hpp>
+#include <algorithm>
 #include <iostream>
+#include <list>
+#include <random>
 
 using namespace spsparse;
 
@@ -143,6 +147,126 @@ TEST_F(XiterTest, Join3Xiter) {
 }
 
 
+// -----------------------------------------------------------
+TEST_F(XiterTest, gallop)
+{
+    std::vector<int> v {1, 3, 3, 5, 8, 13, 21};
+    auto key_at([&v](size_t n) { return v[n]; });
+    for (int key=0; key<25; ++key) {
+        size_t const expected = std::lower_bound(v.begin(), v.end(), key) - v.begin();
+        EXPECT_EQ(expected, gallop(key_at, v.size(), key));
+    }
+    EXPECT_EQ(0, gallop(key_at, 0, 5));
+}
+
+TEST_F(XiterTest, skip_to)
+{
+    // Random-access: galloping
+    std::vector<int> v {1, 3, 5, 8, 13, 21};
+    STLXiter<std::vector<int>::iterator> ii(v.begin(), v.end());
+    ii.skip_to(4);
+    EXPECT_EQ(5, *ii);
+    ii.skip_to(5);
+    EXPECT_EQ(5, *ii);
+    ii.skip_to(21);
+    EXPECT_EQ(21, *ii);
+    ii.skip_to(22);
+    EXPECT_TRUE(ii.eof());
+
+    // Forward-only: linear stepping
+    std::list<int> l(v.begin(), v.end());
+    STLXiter<std::list<int>::iterator> jj(l.begin(), l.end());
+    jj.skip_to(9);
+    EXPECT_EQ(13, *jj);
+    jj.skip_to(100);
+    EXPECT_TRUE(jj.eof());
+
+    // Rows of a matrix
+    VectorCooMatrix<int, double> A({20,10});
+    A.add({1,0}, 15.);
+    A.add({1,3}, 17.);
+    A.add({2,4}, 17.);
+    A.add({6,4}, 10.);
+    A.add({9,4}, 10.);
+    A.consolidate({0,1});
+    auto dbi(A.dim_beginnings_xiter());
+    dbi.skip_to(3);
+    EXPECT_EQ(6, *dbi);
+    auto ii6(dbi.sub_xiter());
+    EXPECT_EQ(4, *ii6);
+    EXPECT_EQ(10., ii6.val());
+    dbi.skip_to(9);
+    EXPECT_EQ(9, *dbi);
+    dbi.skip_to(10);
+    EXPECT_TRUE(dbi.eof());
+}
+
+// -----------------------------------------------------------
+template<class Container1T, class Container2T, class Container3T>
+void test_join(Container1T const &v1, Container2T const &v2, Container3T const &v3)
+{
+    std::vector<int> expected2, expected3;
+    std::set_intersection(v1.begin(), v1.end(), v2.begin(), v2.end(),
+        std::back_inserter(expected2));
+    std::set_intersection(expected2.begin(), expected2.end(), v3.begin(), v3.end(),
+        std::back_inserter(expected3));
+
+    std::vector<int> joined2;
+    for (auto ii(join2_xiter(
+        make_xiter(v1.begin(), v1.end()),
+        make_xiter(v2.begin(), v2.end())));
+        !ii.eof(); ++ii)
+    {
+        EXPECT_EQ(*ii.i1, *ii.i2);
+        joined2.push_back(*ii.i1);
+    }
+    EXPECT_EQ(expected2, joined2);
+
+    std::vector<int> joined3;
+    for (auto ii(join3_xiter(
+        make_xiter(v1.begin(), v1.end()),
+        make_xiter(v2.begin(), v2.end()),
+        make_xiter(v3.begin(), v3.end())));
+        !ii.eof(); ++ii)
+    {
+        EXPECT_EQ(*ii.i1, *ii.i3);
+        joined3.push_back(*ii.i1);
+    }
+    EXPECT_EQ(expected3, joined3);
+}
+
+std::vector<int> random_sorted(std::default_random_engine &generator, int n, int max)
+{
+    std::uniform_int_distribution<int> distro(0, max-1);
+    std::vector<int> ret;
+    for (int i=0; i<n; ++i) ret.push_back(distro(generator));
+    std::sort(ret.begin(), ret.end());
+    ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+    return ret;
+}
+
+TEST_F(XiterTest, join)
+{
+    std::vector<int> v1 {0, 3, 4, 8};
+    std::vector<int> v2 {1, 4, 5, 6, 7, 8, 10};
+    test_join(v1, v2, v2);
+
+    std::default_random_engine generator(17);
+    for (int i=0; i<100; ++i) {
+        // Short rows joined with long rows
+        auto a(random_sorted(generator, 5, 50000));
+        auto b(random_sorted(generator, 20000, 50000));
+        auto c(random_sorted(generator, 200, 50000));
+        test_join(a, b, c);
+        test_join(b, a, c);
+        test_join(c, b, a);
+
+        // Forward-only iterators step linearly
+        std::list<int> bl(b.begin(), b.end());
+        test_join(a, bl, c);
+    }
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();